@@ -0,0 +1,84 @@
+#include "alloccounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+    std::atomic<uint64_t> allocationCount{0};
+    std::atomic<uint64_t> allocatedBytes{0};
+    std::atomic<uint64_t> deallocationCount{0};
+
+    void* countedAlloc(std::size_t size, std::size_t alignment = 0) noexcept
+    {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (size == 0) {
+	    size = 1;
+	}
+	if (alignment > alignof(std::max_align_t)) {
+	    // aligned_alloc requires the size to be a multiple of the alignment.
+	    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+	}
+	return std::malloc(size);
+    }
+
+    void* countedAllocOrThrow(std::size_t size, std::size_t alignment = 0)
+    {
+	void* p = countedAlloc(size, alignment);
+	if (p == nullptr) {
+	    throw std::bad_alloc();
+	}
+	return p;
+    }
+
+    void countedFree(void* p) noexcept
+    {
+	if (p != nullptr) {
+	    deallocationCount.fetch_add(1, std::memory_order_relaxed);
+	    std::free(p);
+	}
+    }
+}
+
+Benchmark::AllocationCounter::Stats Benchmark::AllocationCounter::snapshot()
+{
+    return { allocationCount.load(std::memory_order_relaxed),
+	     allocatedBytes.load(std::memory_order_relaxed),
+	     deallocationCount.load(std::memory_order_relaxed) };
+}
+
+void Benchmark::AllocationCounter::start()
+{
+    begin = snapshot();
+}
+
+Benchmark::AllocationCounter::Stats Benchmark::AllocationCounter::stop() const
+{
+    return snapshot() - begin;
+}
+
+// Replaced global allocation functions:
+
+void* operator new(std::size_t size) { return countedAllocOrThrow(size); }
+void* operator new[](std::size_t size) { return countedAllocOrThrow(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new(std::size_t size, std::align_val_t al) { return countedAllocOrThrow(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return countedAllocOrThrow(size, static_cast<std::size_t>(al)); }
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return countedAlloc(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return countedAlloc(size, static_cast<std::size_t>(al)); }
+
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, std::size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, std::size_t) noexcept { countedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { countedFree(p); }
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Benchmark {
+
+  /*
+   * Process-wide allocation statistics collected by the replaced global operator new / delete in alloccounter.cpp.
+   * Only executables that link alloccounter.cpp count allocations; the surface library itself is unaffected.
+  */
+  class AllocationCounter
+  {
+  public:
+    struct Stats {
+	uint64_t allocations = 0;
+	uint64_t bytes = 0;
+	uint64_t deallocations = 0;
+
+	Stats operator-(const Stats& s) const
+	{
+	    return { allocations - s.allocations, bytes - s.bytes, deallocations - s.deallocations };
+	}
+    };
+
+    static Stats snapshot();
+
+    /*
+     * Counts the allocations between start() and stop() (of all threads).
+    */
+    void start();
+
+    Stats stop() const;
+
+  private:
+    Stats begin;
+  };
+}
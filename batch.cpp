@@ -0,0 +1,444 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "boundaryreader.h"
+#include "geometrywriter.h"
+#include "modifiedgordonwixomsurface.h"
+#include "parallel.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+    using Geometry::ModifiedGordonWixomSurface;
+
+    enum class HeightSource {
+	Samples,	// The heights of the boundary file
+	Constant,	// h
+	Linear		// a * x + b * y + c
+    };
+
+    struct Job {
+	std::string name;
+	size_t line = 0;		// Of the section header
+	std::string boundary;		// Boundary file (see boundaryreader.h), unless polar
+	std::optional<Geometry::PolarCurve> polar;
+	HeightSource height = HeightSource::Samples;
+	double coefficients[3] = { 0.0, 0.0, 0.0 };
+	ModifiedGordonWixomSurface::HeightInterpolation interpolation = ModifiedGordonWixomSurface::HeightInterpolation::Cubic;
+	int directions = 128;
+	int resolution = 256;		// Curve resolution of polar boundaries
+	GeometryOptions options;
+	std::string output;
+    };
+
+    struct JobResult {
+	bool ok = false;
+	std::string error;
+	size_t loops = 0;
+	double loadSeconds = 0.0;
+	double buildSeconds = 0.0;
+	double writeSeconds = 0.0;
+    };
+
+    void printUsage(const char* program)
+    {
+	std::printf("Usage: %s [--threads N] [--triangulation-cache DIR] MANIFEST\n"
+		    "  --threads N                 threads shared by all jobs and their parallel loops (default: hardware threads)\n"
+		    "  --triangulation-cache DIR   also store the triangulations in DIR for later runs\n"
+		    "\n"
+		    "The manifest has a section per job, [job NAME] (or [NAME]), with lines KEY = VALUE;\n"
+		    "[defaults] sets the values of the jobs after it, and lines starting with # or ; are comments.\n"
+		    "  boundary = FILE                  sampled boundary loops (.bin, .csv or text, see boundaryreader.h)\n"
+		    "  boundary = polar CX CY R0 [K A PHASE]...   r(theta) = R0 + sum A sin(K theta + PHASE) around (CX, CY)\n"
+		    "  height = samples | constant H | linear A B C   heights of the boundary file, H or A x + B y + C\n"
+		    "  interpolation = cubic | linear   of the sampled heights\n"
+		    "  area = A                         maximal triangle area\n"
+		    "  directions = N                   line directions of eval\n"
+		    "  resolution = N                   discretization of polar boundaries\n"
+		    "  adaptive = TOL                   refine by curvature to TOL times the height range (0: uniform)\n"
+		    "  structured = yes | no            mesh star-shaped domains by rings around center\n"
+		    "  center = X Y\n"
+		    "  reorder = yes | no               reorder vertices and faces for locality\n"
+		    "  normals = yes | no\n"
+		    "  format = obj | ply | stl\n"
+		    "  precision = N                    significant digits of OBJ coordinates\n"
+		    "  output = FILE                    (default: NAME.FORMAT next to the manifest)\n",
+		    program);
+    }
+
+    std::string trim(const std::string& s)
+    {
+	size_t first = s.find_first_not_of(" \t\r");
+	if (first == std::string::npos) {
+	    return std::string();
+	}
+	size_t last = s.find_last_not_of(" \t\r");
+	return s.substr(first, last - first + 1);
+    }
+
+    // All whitespace-separated numbers of value; throws unless there are between min and max of them.
+    std::vector<double> numbers(const std::string& value, size_t min, size_t max)
+    {
+	std::istringstream stream(value);
+	std::vector<double> result;
+	std::string word;
+	while (stream >> word) {
+	    char* end;
+	    double x = std::strtod(word.c_str(), &end);
+	    if (*end != '\0' || end == word.c_str()) {
+		throw std::invalid_argument("\"" + word + "\" is not a number");
+	    }
+	    result.push_back(x);
+	}
+	if (result.size() < min || result.size() > max) {
+	    throw std::invalid_argument("expected " + std::to_string(min) + (max > min ? " or more" : "") + " numbers");
+	}
+	return result;
+    }
+
+    double number(const std::string& value)
+    {
+	return numbers(value, 1, 1)[0];
+    }
+
+    int positiveInteger(const std::string& value)
+    {
+	double x = number(value);
+	if (x < 1.0 || x != std::floor(x) || x > 1.0e9) {
+	    throw std::invalid_argument("expected a positive integer");
+	}
+	return static_cast<int>(x);
+    }
+
+    bool flag(const std::string& value)
+    {
+	if (value == "yes" || value == "true" || value == "1") {
+	    return true;
+	}
+	if (value == "no" || value == "false" || value == "0") {
+	    return false;
+	}
+	throw std::invalid_argument("expected yes or no");
+    }
+
+    // Splits the first word off value.
+    std::string firstWord(const std::string& value, std::string& rest)
+    {
+	size_t end = value.find_first_of(" \t");
+	rest = (end == std::string::npos) ? std::string() : trim(value.substr(end));
+	return value.substr(0, end);
+    }
+
+    void setValue(Job& job, const std::string& key, const std::string& value, const std::filesystem::path& directory)
+    {
+	std::string rest;
+	if (key == "boundary") {
+	    if (firstWord(value, rest) == "polar") {
+		std::vector<double> v = numbers(rest, 3, SIZE_MAX);
+		if (v.size() % 3 != 0) {
+		    throw std::invalid_argument("expected CX CY R0 and triples K A PHASE");
+		}
+		std::vector<Geometry::PolarCurve::Harmonic> harmonics;
+		for (size_t i = 3; i < v.size(); i += 3) {
+		    harmonics.push_back({ static_cast<int>(v[i]), v[i + 1], v[i + 2] });
+		}
+		job.polar.emplace(Geometry::Point2D(v[0], v[1]), v[2], harmonics);
+		job.boundary.clear();
+	    }
+	    else {
+		job.boundary = (directory / value).string();
+		job.polar.reset();
+	    }
+	}
+	else if (key == "height") {
+	    std::string source = firstWord(value, rest);
+	    if (source == "samples" && rest.empty()) {
+		job.height = HeightSource::Samples;
+	    }
+	    else if (source == "constant") {
+		job.height = HeightSource::Constant;
+		job.coefficients[0] = number(rest);
+	    }
+	    else if (source == "linear") {
+		job.height = HeightSource::Linear;
+		std::vector<double> v = numbers(rest, 3, 3);
+		std::copy(v.begin(), v.end(), job.coefficients);
+	    }
+	    else {
+		throw std::invalid_argument("expected samples, constant H or linear A B C");
+	    }
+	}
+	else if (key == "interpolation") {
+	    if (value == "cubic") {
+		job.interpolation = ModifiedGordonWixomSurface::HeightInterpolation::Cubic;
+	    }
+	    else if (value == "linear") {
+		job.interpolation = ModifiedGordonWixomSurface::HeightInterpolation::Linear;
+	    }
+	    else {
+		throw std::invalid_argument("expected cubic or linear");
+	    }
+	}
+	else if (key == "area") {
+	    job.options.maxArea = number(value);
+	    if (!(job.options.maxArea > 0.0)) {
+		throw std::invalid_argument("the area has to be positive");
+	    }
+	}
+	else if (key == "directions") {
+	    job.directions = positiveInteger(value);
+	}
+	else if (key == "resolution") {
+	    job.resolution = std::max(3, positiveInteger(value));
+	}
+	else if (key == "adaptive") {
+	    job.options.adaptiveTolerance = number(value);
+	}
+	else if (key == "structured") {
+	    job.options.structured = flag(value);
+	}
+	else if (key == "center") {
+	    std::vector<double> v = numbers(value, 2, 2);
+	    job.options.center = Geometry::Point2D(v[0], v[1]);
+	}
+	else if (key == "reorder") {
+	    job.options.reorder = flag(value);
+	}
+	else if (key == "normals") {
+	    job.options.normals = flag(value);
+	}
+	else if (key == "format") {
+	    if (value == "obj") {
+		job.options.format = MeshFormat::OBJ;
+	    }
+	    else if (value == "ply") {
+		job.options.format = MeshFormat::PLY;
+	    }
+	    else if (value == "stl") {
+		job.options.format = MeshFormat::STL;
+	    }
+	    else {
+		throw std::invalid_argument("expected obj, ply or stl");
+	    }
+	}
+	else if (key == "precision") {
+	    job.options.precision = positiveInteger(value);
+	}
+	else if (key == "output") {
+	    job.output = (directory / value).string();
+	}
+	else {
+	    throw std::invalid_argument("unknown key \"" + key + "\"");
+	}
+    }
+
+    // Throws std::invalid_argument with the file and line of the first error.
+    std::vector<Job> readManifest(const std::string& filename)
+    {
+	std::ifstream file(filename);
+	if (!file) {
+	    throw std::invalid_argument(filename + ": cannot be read");
+	}
+	const std::filesystem::path directory = std::filesystem::path(filename).parent_path();
+	Job defaults;
+	defaults.options.verbose = false;	// Jobs run concurrently.
+	std::vector<Job> jobs;
+	Job* section = nullptr;
+	std::string line;
+	for (size_t number = 1; std::getline(file, line); number++) {
+	    line = trim(line);
+	    if (line.empty() || line[0] == '#' || line[0] == ';') {
+		continue;
+	    }
+	    try {
+		if (line[0] == '[') {
+		    if (line.back() != ']') {
+			throw std::invalid_argument("expected [defaults] or [job NAME]");
+		    }
+		    std::string name = trim(line.substr(1, line.size() - 2));
+		    if (name == "defaults") {
+			section = &defaults;
+			continue;
+		    }
+		    if (name.compare(0, 4, "job ") == 0) {
+			name = trim(name.substr(4));
+		    }
+		    if (name.empty()) {
+			throw std::invalid_argument("a job needs a name");
+		    }
+		    jobs.push_back(defaults);
+		    jobs.back().name = name;
+		    jobs.back().line = number;
+		    section = &jobs.back();
+		    continue;
+		}
+		size_t equals = line.find('=');
+		if (equals == std::string::npos) {
+		    throw std::invalid_argument("expected KEY = VALUE");
+		}
+		if (section == nullptr) {
+		    throw std::invalid_argument("values have to follow [defaults] or [job NAME]");
+		}
+		setValue(*section, trim(line.substr(0, equals)), trim(line.substr(equals + 1)), directory);
+	    }
+	    catch (const std::invalid_argument& e) {
+		throw std::invalid_argument(filename + ":" + std::to_string(number) + ": " + e.what());
+	    }
+	}
+
+	for (Job& job : jobs) {
+	    auto fail = [&](const char* message) {
+		return std::invalid_argument(filename + ":" + std::to_string(job.line) + ": job " + job.name + ": " + message);
+	    };
+	    if (job.boundary.empty() && !job.polar) {
+		throw fail("no boundary");
+	    }
+	    if (job.polar && job.height == HeightSource::Samples) {
+		throw fail("a polar boundary needs a constant or linear height");
+	    }
+	    if (job.output.empty()) {
+		const char* extension = (job.options.format == MeshFormat::OBJ) ? ".obj" : (job.options.format == MeshFormat::PLY) ? ".ply" : ".stl";
+		job.output = (directory / (job.name + extension)).string();
+	    }
+	}
+	return jobs;
+    }
+
+    double heightAt(const Job& job, double x, double y)
+    {
+	if (job.height == HeightSource::Constant) {
+	    return job.coefficients[0];
+	}
+	return job.coefficients[0] * x + job.coefficients[1] * y + job.coefficients[2];
+    }
+
+    double secondsSince(Clock::time_point& start)
+    {
+	Clock::time_point now = Clock::now();
+	double seconds = std::chrono::duration<double>(now - start).count();
+	start = now;
+	return seconds;
+    }
+
+    JobResult runJob(const Job& job, Geometry::TriangulationCache& cache)
+    {
+	JobResult result;
+	try {
+	    Clock::time_point start = Clock::now();
+	    std::optional<ModifiedGordonWixomSurface> surface;
+	    if (job.polar) {
+		surface.emplace(*job.polar, [&job](Geometry::Point2D p) { return heightAt(job, p[0], p[1]); });
+		surface->setCurveResolution(job.resolution);
+		result.loops = 1;
+	    }
+	    else {
+		Geometry::BoundaryLoops loops = Geometry::readBoundary(job.boundary);
+		if (loops.empty()) {
+		    throw std::runtime_error("cannot read " + job.boundary);
+		}
+		result.loops = loops.size();
+		result.loadSeconds = secondsSince(start);
+
+		// Other height sources replace the heights of the samples once:
+		Geometry::SampledBoundary replaced;
+		if (job.height != HeightSource::Samples) {
+		    for (size_t l = 0; l < loops.size(); l++) {
+			replaced.emplace_back(loops[l].begin(), loops[l].end());
+			for (Geometry::Point3D& p : replaced.back()) {
+			    p[2] = heightAt(job, p[0], p[1]);
+			}
+		    }
+		    loops = Geometry::BoundaryLoops(std::move(replaced));
+		}
+		surface.emplace(loops[0], job.interpolation);
+		for (size_t l = 1; l < loops.size(); l++) {
+		    surface->addInnerLoop(loops[l], job.interpolation);
+		}
+	    }
+	    surface->setDirectionCount(job.directions);
+	    result.buildSeconds = secondsSince(start);
+
+	    GeometryOptions options = job.options;
+	    options.triangulationCache = &cache;
+	    result.ok = write_geometry(*surface, job.output.c_str(), options);
+	    if (!result.ok) {
+		result.error = "cannot write " + job.output;
+	    }
+	    result.writeSeconds = secondsSince(start);
+	}
+	catch (const std::exception& e) {
+	    result.error = e.what();
+	}
+	return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* manifest = nullptr;
+    std::string cacheDirectory;
+    for (int i = 1; i < argc; i++) {
+	if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+	    Geometry::ThreadPool::setThreadCount(std::max(1, std::atoi(argv[++i])));
+	}
+	else if (std::strcmp(argv[i], "--triangulation-cache") == 0 && i + 1 < argc) {
+	    cacheDirectory = argv[++i];
+	}
+	else if (argv[i][0] != '-' && manifest == nullptr) {
+	    manifest = argv[i];
+	}
+	else {
+	    printUsage(argv[0]);
+	    return 1;
+	}
+    }
+    if (manifest == nullptr) {
+	printUsage(argv[0]);
+	return 1;
+    }
+
+    std::vector<Job> jobs;
+    try {
+	jobs = readManifest(manifest);
+    }
+    catch (const std::invalid_argument& e) {
+	std::printf("%s\n", e.what());
+	return 1;
+    }
+
+    // Jobs are spread over the shared pool one at a time; the parallel loops within a job get the threads left idle,
+    // which towards the end of the run are all but the ones still busy with other jobs.
+    Geometry::TriangulationCache cache(cacheDirectory);
+    std::vector<JobResult> results(jobs.size());
+    Clock::time_point start = Clock::now();
+    Geometry::parallelFor(jobs.size(), [&](size_t i) { results[i] = runJob(jobs[i], cache); }, 1);
+    double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::printf("%-16s %6s %5s %10s %10s %10s %10s  %s\n", "job", "status", "loops", "load [ms]", "build [ms]", "write [ms]",
+		"total [ms]", "output");
+    size_t failed = 0;
+    double jobSeconds = 0.0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+	const JobResult& r = results[i];
+	double total = r.loadSeconds + r.buildSeconds + r.writeSeconds;
+	jobSeconds += total;
+	failed += r.ok ? 0 : 1;
+	std::printf("%-16s %6s %5zu %10.2f %10.2f %10.2f %10.2f  %s\n", jobs[i].name.c_str(), r.ok ? "ok" : "FAILED", r.loops,
+		    r.loadSeconds * 1e3, r.buildSeconds * 1e3, r.writeSeconds * 1e3, total * 1e3,
+		    r.ok ? jobs[i].output.c_str() : r.error.c_str());
+    }
+    std::printf("%zu jobs (%zu failed) in %.3f s on %zu threads: %.3f s of job time, %zu triangulations reused\n", jobs.size(),
+		failed, wallSeconds, Geometry::ThreadPool::shared().threadCount(), jobSeconds, cache.hits());
+    return (failed > 0) ? 2 : 0;
+}
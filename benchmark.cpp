@@ -0,0 +1,477 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "alloccounter.h"
+#include "geometrywriter.h"
+#include "harmonicreference.h"
+#include "modifiedgordonwixomsurface.h"
+#include "perfcounters.h"
+
+namespace {
+
+    struct BenchmarkCase {
+	const char* name;
+	std::function<Geometry::Point2D(double)> curve;
+	std::function<double(Geometry::Point2D)> height;
+	Geometry::PolarCurve polar;	// The same boundary in polar form
+    };
+
+    // A subset of the domains of main.cpp: convex, mildly and strongly concave boundaries.
+    std::vector<BenchmarkCase> benchmarkCases()
+    {
+	auto lobes = [](double r, double a, int k) {
+	    return [=](double t) {
+		double radius = r + a * std::sin(t * k * 2 * M_PI);
+		return Geometry::Point2D(radius * std::cos(t * 2 * M_PI), radius * std::sin(t * 2 * M_PI));
+	    };
+	};
+	auto polarLobes = [](double r, double a, int k) { return Geometry::PolarCurve(Geometry::Point2D(0.0, 0.0), r, { { k, a, 0.0 } }); };
+	auto wave = [](Geometry::Point2D p) { return 0.5 * std::sin(p[0] * 2 * M_PI) + 0.5 * std::sin(p[0] * 2 * M_PI); };
+	auto ripple = [](Geometry::Point2D p) {
+	    return std::sin(std::sqrt(std::pow(p[0], 2) + std::pow(p[1], 2)) * M_PI) + (std::pow(p[0], 2) + std::pow(p[1], 2)) * 0.1;
+	};
+	return {
+	    { "circle", lobes(2.0, 0.0, 0), wave, polarLobes(2.0, 0.0, 0) },
+	    { "lobes4", lobes(2.0, 0.5, 4), wave, polarLobes(2.0, 0.5, 4) },
+	    { "lobes6", lobes(2.0, 1.0, 6), ripple, polarLobes(2.0, 1.0, 6) },
+	};
+    }
+
+    // The boundary of a case sampled with its heights, like measured data.
+    Geometry::PointVector sampleBoundary(const BenchmarkCase& c, int resolution)
+    {
+	Geometry::PointVector samples;
+	for (int i = 0; i < resolution; i++) {
+	    Geometry::Point2D p = c.curve(i / (double)resolution);
+	    samples.push_back(Geometry::Point3D(p[0], p[1], c.height(p)));
+	}
+	return samples;
+    }
+
+    // Crossing number test against the discretized boundary.
+    bool isInside(const std::vector<Geometry::Point2D>& polygon, const Geometry::Point2D& p)
+    {
+	bool inside = false;
+	for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+	    if ((polygon[i][1] > p[1]) != (polygon[j][1] > p[1])
+		&& p[0] < (polygon[j][0] - polygon[i][0]) * (p[1] - polygon[i][1]) / (polygon[j][1] - polygon[i][1]) + polygon[i][0]) {
+		inside = !inside;
+	    }
+	}
+	return inside;
+    }
+
+    // Regular grid over the bounding rectangle, restricted to the interior of the domain.
+    std::vector<Geometry::Point2D> queryPoints(const Geometry::ModifiedGordonWixomSurface& surface, int resolution)
+    {
+	std::vector<Geometry::Point2D> points;
+	Geometry::Point2D min = surface.getBoundingRectangleMin();
+	Geometry::Point2D max = surface.getBoundingRectangleMax();
+	for (int i = 0; i < resolution; i++) {
+	    for (int j = 0; j < resolution; j++) {
+		Geometry::Point2D p(min[0] + (max[0] - min[0]) * (i + 0.5) / resolution,
+				    min[1] + (max[1] - min[1]) * (j + 0.5) / resolution);
+		if (isInside(surface.getDiscretizedCurve(), p)) {
+		    points.push_back(p);
+		}
+	    }
+	}
+	return points;
+    }
+
+    struct Options {
+	bool perf = false;
+	bool alloc = false;
+	int grid = 32;
+	const char* writeDirectory = nullptr;
+	GeometryOptions geometry;
+	int lodLevels = 0;
+	bool polar = false;
+	bool sampled = false;
+	std::map<std::string, double> budgets;	// Maximum allocations per operation of a region.
+	bool pareto = false;
+	int paretoPoints = 100;
+	double referenceArea = 2.0e-4;
+    };
+
+    void printUsage(const char* program)
+    {
+	std::printf("Usage: %s [--perf] [--alloc] [--budget REGION=N]... [--grid N] [--polar | --sampled] [--write DIR [--ply] [--normals] [--reorder] [--adaptive TOL] [--structured] [--lod N]]\n"
+		    "       %s --pareto [--pareto-points N] [--reference-area A]\n"
+		    "  --perf              read hardware performance counters around each measured region\n"
+		    "  --alloc             report heap allocations and allocated bytes per operation\n"
+		    "  --budget REGION=N   fail if a region (construct, eval, gradient, write, reevaluate, lod) allocates more than N times per operation\n"
+		    "  --grid N            evaluate on an N x N grid over the bounding rectangle (default: 32)\n"
+		    "  --polar             intersect the boundaries in their polar form instead of as polygons\n"
+		    "  --sampled           sample the boundaries and their heights once and interpolate the heights cubically\n"
+		    "                      instead of calling the height functions\n"
+		    "  --write DIR         also measure write_geometry, writing the meshes into DIR\n"
+		    "  --ply               write binary PLY instead of OBJ\n"
+		    "  --normals           also write vertex normals\n"
+		    "  --reorder           reorder vertices and faces for locality before evaluating the written meshes\n"
+		    "  --adaptive TOL      refine the written meshes by estimated curvature, to TOL times the height range\n"
+		    "  --structured        mesh star-shaped domains by rings and spokes around the origin instead of Triangle\n"
+		    "  --lod N             also measure write_geometry_lod, writing N levels of detail\n"
+		    "  --pareto            measure error against a finite element harmonic reference and runtime\n"
+		    "                      over direction counts and curve resolutions, and print the Pareto front\n"
+		    "  --pareto-points N   number of reference vertices the error is measured at (default: 100)\n"
+		    "  --reference-area A  maximum triangle area of the reference mesh (default: 2e-4)\n",
+		    program, program);
+    }
+
+    bool parseBudget(const char* arg, Options& options)
+    {
+	const char* separator = std::strchr(arg, '=');
+	if (separator == nullptr || separator == arg) {
+	    return false;
+	}
+	char* end;
+	double budget = std::strtod(separator + 1, &end);
+	if (*end != '\0' || budget < 0.0) {
+	    return false;
+	}
+	options.budgets[std::string(arg, separator)] = budget;
+	return true;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+	for (int i = 1; i < argc; i++) {
+	    if (std::strcmp(argv[i], "--perf") == 0) {
+		options.perf = true;
+	    }
+	    else if (std::strcmp(argv[i], "--alloc") == 0) {
+		options.alloc = true;
+	    }
+	    else if (std::strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+		if (!parseBudget(argv[++i], options)) {
+		    return false;
+		}
+		options.alloc = true;
+	    }
+	    else if (std::strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+		options.grid = std::atoi(argv[++i]);
+	    }
+	    else if (std::strcmp(argv[i], "--polar") == 0) {
+		options.polar = true;
+	    }
+	    else if (std::strcmp(argv[i], "--sampled") == 0) {
+		options.sampled = true;
+	    }
+	    else if (std::strcmp(argv[i], "--write") == 0 && i + 1 < argc) {
+		options.writeDirectory = argv[++i];
+	    }
+	    else if (std::strcmp(argv[i], "--ply") == 0) {
+		options.geometry.format = MeshFormat::PLY;
+	    }
+	    else if (std::strcmp(argv[i], "--normals") == 0) {
+		options.geometry.normals = true;
+	    }
+	    else if (std::strcmp(argv[i], "--reorder") == 0) {
+		options.geometry.reorder = true;
+	    }
+	    else if (std::strcmp(argv[i], "--structured") == 0) {
+		options.geometry.structured = true;
+	    }
+	    else if (std::strcmp(argv[i], "--lod") == 0 && i + 1 < argc) {
+		options.lodLevels = std::atoi(argv[++i]);
+	    }
+	    else if (std::strcmp(argv[i], "--adaptive") == 0 && i + 1 < argc) {
+		options.geometry.adaptiveTolerance = std::atof(argv[++i]);
+	    }
+	    else if (std::strcmp(argv[i], "--pareto") == 0) {
+		options.pareto = true;
+	    }
+	    else if (std::strcmp(argv[i], "--pareto-points") == 0 && i + 1 < argc) {
+		options.paretoPoints = std::atoi(argv[++i]);
+	    }
+	    else if (std::strcmp(argv[i], "--reference-area") == 0 && i + 1 < argc) {
+		options.referenceArea = std::atof(argv[++i]);
+	    }
+	    else {
+		return false;
+	    }
+	}
+	return options.grid > 0 && options.lodLevels >= 0 && options.paretoPoints > 0 && options.referenceArea > 0.0;
+    }
+
+    class Harness
+    {
+    public:
+	explicit Harness(const Options& options)
+	    : options(options), counters(options.perf) {}
+
+	void printHeader()
+	{
+	    if (options.perf && !counters.available()) {
+		std::printf("Hardware performance counters are not available, reporting wall time only.\n");
+	    }
+	    else if (options.perf) {
+		for (int e = 0; e < Benchmark::PerfCounters::EventCount; e++) {
+		    auto event = static_cast<Benchmark::PerfCounters::Event>(e);
+		    if (!counters.available(event)) {
+			std::printf("Counter %s is not available.\n", Benchmark::PerfCounters::name(event));
+		    }
+		}
+	    }
+	    std::printf("%-8s %-10s %8s %12s %12s", "case", "region", "count", "time [ms]", "us / op");
+	    if (options.alloc) {
+		std::printf(" %12s %14s", "allocs / op", "bytes / op");
+	    }
+	    if (counters.available()) {
+		std::printf(" %8s %14s %14s %14s", "IPC", "br-miss / op", "L1D-miss / op", "LLC-miss / op");
+	    }
+	    std::printf("\n");
+	}
+
+	/*
+	 * Runs f once inside a measured region and prints wall time, allocations and, if available, counters per operation.
+	*/
+	template <typename F>
+	void measure(const char* caseName, const char* region, size_t count, F&& f)
+	{
+	    Benchmark::AllocationCounter allocations;
+	    auto begin = std::chrono::steady_clock::now();
+	    allocations.start();
+	    counters.start();
+	    f();
+	    Benchmark::PerfCounters::Sample sample = counters.stop();
+	    Benchmark::AllocationCounter::Stats allocated = allocations.stop();
+	    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	    std::printf("%-8s %-10s %8zu %12.3f %12.3f", caseName, region, count, seconds * 1e3, seconds * 1e6 / count);
+	    if (options.alloc) {
+		std::printf(" %12.1f %14.1f", static_cast<double>(allocated.allocations) / count,
+			    static_cast<double>(allocated.bytes) / count);
+	    }
+	    printCounters(sample, count);
+	    std::printf("\n");
+
+	    auto budget = options.budgets.find(region);
+	    if (budget != options.budgets.end() && static_cast<double>(allocated.allocations) / count > budget->second) {
+		char violation[256];
+		std::snprintf(violation, sizeof(violation), "%s/%s: %.1f allocations per operation, budget is %g",
+			      caseName, region, static_cast<double>(allocated.allocations) / count, budget->second);
+		violations.push_back(violation);
+	    }
+	}
+
+	/*
+	 * Prints the budget violations and returns whether every region stayed within its budget.
+	*/
+	bool checkBudgets() const
+	{
+	    for (const std::string& violation : violations) {
+		std::printf("Allocation budget exceeded: %s\n", violation.c_str());
+	    }
+	    return violations.empty();
+	}
+
+    private:
+	void printCounter(const Benchmark::PerfCounters::Sample& sample, Benchmark::PerfCounters::Event e, size_t count)
+	{
+	    if (sample.has(e)) {
+		std::printf(" %14.1f", sample[e] / count);
+	    }
+	    else {
+		std::printf(" %14s", "n/a");
+	    }
+	}
+
+	void printCounters(const Benchmark::PerfCounters::Sample& sample, size_t count)
+	{
+	    using Event = Benchmark::PerfCounters::Event;
+	    if (!counters.available()) {
+		return;
+	    }
+	    if (sample.has(Event::Cycles) && sample.has(Event::Instructions) && sample[Event::Cycles] > 0) {
+		std::printf(" %8.2f", sample[Event::Instructions] / sample[Event::Cycles]);
+	    }
+	    else {
+		std::printf(" %8s", "n/a");
+	    }
+	    printCounter(sample, Event::BranchMisses, count);
+	    printCounter(sample, Event::L1DMisses, count);
+	    printCounter(sample, Event::LLCMisses, count);
+	}
+
+	const Options& options;
+	Benchmark::PerfCounters counters;
+	std::vector<std::string> violations;
+    };
+
+    struct QualitySetting {
+	int directions;
+	int curveResolution;
+	double secondsPerEval;
+	double rmsError;
+	double maxError;
+	bool isPareto = false;
+    };
+
+    /*
+     * Settings not dominated by another one that is both at least as fast and at least as accurate (RMS error).
+    */
+    void markParetoFront(std::vector<QualitySetting>& settings)
+    {
+	for (QualitySetting& s : settings) {
+	    s.isPareto = true;
+	    for (const QualitySetting& other : settings) {
+		bool dominates = other.secondsPerEval <= s.secondsPerEval && other.rmsError <= s.rmsError
+		    && (other.secondsPerEval < s.secondsPerEval || other.rmsError < s.rmsError);
+		if (dominates) {
+		    s.isPareto = false;
+		    break;
+		}
+	    }
+	}
+    }
+
+    void runPareto(const Options& options)
+    {
+	constexpr int directionCounts[] = { 8, 16, 32, 64, 128, 256 };
+	constexpr int curveResolutions[] = { 32, 64, 128, 256, 512 };
+	constexpr int referenceBoundarySamples = 4096;
+
+	for (const BenchmarkCase& c : benchmarkCases()) {
+	    auto begin = std::chrono::steady_clock::now();
+	    Benchmark::HarmonicReference reference =
+		Benchmark::solveHarmonicReference(c.curve, c.height, referenceBoundarySamples, options.referenceArea);
+	    double referenceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	    // Spread the error samples evenly over the interior vertices of the reference mesh:
+	    std::vector<size_t> interior;
+	    for (size_t i = 0; i < reference.points.size(); i++) {
+		if (!reference.isBoundary[i]) {
+		    interior.push_back(i);
+		}
+	    }
+	    std::vector<size_t> samples;
+	    size_t stride = std::max<size_t>(1, interior.size() / options.paretoPoints);
+	    for (size_t i = 0; i < interior.size() && samples.size() < static_cast<size_t>(options.paretoPoints); i += stride) {
+		samples.push_back(interior[i]);
+	    }
+	    std::printf("%s: reference with %zu vertices (%d CG iterations, %.1f s), error measured at %zu points\n",
+			c.name, reference.points.size(), reference.iterations, referenceSeconds, samples.size());
+
+	    std::vector<QualitySetting> settings;
+	    for (int resolution : curveResolutions) {
+		Geometry::ModifiedGordonWixomSurface surface(c.curve, c.height);
+		surface.setCurveResolution(resolution);
+		for (int directions : directionCounts) {
+		    surface.setDirectionCount(directions);
+		    std::vector<double> values(samples.size());
+		    auto start = std::chrono::steady_clock::now();
+		    for (size_t i = 0; i < samples.size(); i++) {
+			values[i] = surface.eval(reference.points[samples[i]]);
+		    }
+		    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		    double squaredError = 0.0, maxError = 0.0;
+		    for (size_t i = 0; i < samples.size(); i++) {
+			double error = std::abs(values[i] - reference.values[samples[i]]);
+			squaredError += error * error;
+			maxError = std::max(maxError, error);
+		    }
+		    settings.push_back({ directions, resolution, seconds / samples.size(),
+					 std::sqrt(squaredError / samples.size()), maxError });
+		}
+	    }
+	    markParetoFront(settings);
+
+	    std::printf("%-8s %10s %10s %12s %12s %12s %7s\n", "case", "directions", "samples", "us / eval", "RMS error", "max error", "pareto");
+	    for (const QualitySetting& s : settings) {
+		std::printf("%-8s %10d %10d %12.3f %12.3e %12.3e %7s\n", c.name, s.directions, s.curveResolution,
+			    s.secondsPerEval * 1e6, s.rmsError, s.maxError, s.isPareto ? "*" : "");
+	    }
+	    std::sort(settings.begin(), settings.end(), [](const QualitySetting& a, const QualitySetting& b) {
+		return a.secondsPerEval < b.secondsPerEval;
+	    });
+	    std::printf("%s Pareto front (fastest first):", c.name);
+	    for (const QualitySetting& s : settings) {
+		if (s.isPareto) {
+		    std::printf(" %d/%d", s.directions, s.curveResolution);
+		}
+	    }
+	    std::printf("\n\n");
+	}
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+	printUsage(argv[0]);
+	return 1;
+    }
+
+    if (options.pareto) {
+	runPareto(options);
+	return 0;
+    }
+
+    Harness harness(options);
+    harness.printHeader();
+
+    double checksum = 0.0;
+    for (const BenchmarkCase& c : benchmarkCases()) {
+	std::vector<Geometry::ModifiedGordonWixomSurface> surface;
+	surface.reserve(1);
+	harness.measure(c.name, "construct", 1, [&]() {
+	    if (options.polar) {
+		surface.emplace_back(c.polar, c.height);
+	    }
+	    else if (options.sampled) {
+		surface.emplace_back(sampleBoundary(c, 256));
+	    }
+	    else {
+		surface.emplace_back(c.curve, c.height);
+	    }
+	});
+
+	std::vector<Geometry::Point2D> points = queryPoints(surface[0], options.grid);
+	harness.measure(c.name, "eval", points.size(), [&]() {
+	    for (const Geometry::Point2D& p : points) {
+		checksum += surface[0].eval(p);
+	    }
+	});
+
+	harness.measure(c.name, "gradient", points.size(), [&]() {
+	    for (const Geometry::Point2D& p : points) {
+		auto [u, gradient] = surface[0].evalWithGradient(p);
+		checksum += u;
+	    }
+	});
+
+	if (options.writeDirectory != nullptr) {
+	    std::string filename = std::string(options.writeDirectory) + "/" + c.name
+		+ (options.geometry.format == MeshFormat::PLY ? ".ply" : ".obj");
+	    harness.measure(c.name, "write", 1, [&]() { write_geometry(surface[0], filename.c_str(), options.geometry); });
+	    if (options.geometry.format == MeshFormat::OBJ) {
+		// Same layout again, without re-triangulating:
+		std::string output = std::string(options.writeDirectory) + "/" + c.name + ".reevaluated.obj";
+		harness.measure(c.name, "reevaluate", 1, [&]() {
+		    reevaluate_geometry(surface[0], filename.c_str(), output.c_str(), options.geometry);
+		});
+	    }
+	    if (options.lodLevels > 0) {
+		std::vector<std::string> filenames;
+		for (int level = 0; level < options.lodLevels; level++) {
+		    filenames.push_back(std::string(options.writeDirectory) + "/" + c.name + ".lod" + std::to_string(level)
+					+ (options.geometry.format == MeshFormat::PLY ? ".ply" : ".obj"));
+		}
+		harness.measure(c.name, "lod", 1, [&]() { write_geometry_lod(surface[0], filenames, options.geometry); });
+	    }
+	}
+    }
+    std::printf("Checksum: %g\n", checksum);
+    return harness.checkBudgets() ? 0 : 2;
+}
@@ -0,0 +1,261 @@
+#include "boundaryreader.h"
+#include "mappedfile.h"
+#include "meshwriter.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+// Binary samples are used in place as Point3D:
+static_assert(sizeof(Geometry::Point3D) == 3 * sizeof(double) && std::is_trivially_copyable_v<Geometry::Point3D>);
+
+namespace {
+
+    constexpr char binaryMagic[4] = { 'P', 'H', 'B', 'L' };
+    constexpr uint32_t binaryVersion = 1;
+
+    bool isBlank(char c)
+    {
+	return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // Parses a number after blanks at p and moves p past it.
+    template <typename T>
+    bool parseNumber(const char*& p, const char* end, T& value)
+    {
+	while (p < end && isBlank(*p)) {
+	    p++;
+	}
+	auto [next, error] = std::from_chars(p, end, value);
+	p = next;
+	return error == std::errc();
+    }
+
+    // Skips the separator at p (after blanks).
+    bool parseSeparator(const char*& p, const char* end, char separator)
+    {
+	while (p < end && isBlank(*p)) {
+	    p++;
+	}
+	return p < end && *p++ == separator;
+    }
+
+    // True if only blanks are left.
+    bool atEnd(const char* p, const char* end)
+    {
+	while (p < end && isBlank(*p)) {
+	    p++;
+	}
+	return p == end;
+    }
+
+    // Calls parseRow(begin, end) for every row of the file (without its line break), reading the file in blocks.
+    // Stops at the first row parseRow returns false for and returns false then, or if the file cannot be read.
+    template <typename ParseRow>
+    bool forEachRow(const std::string& filename, ParseRow parseRow)
+    {
+	std::FILE* file = std::fopen(filename.c_str(), "rb");
+	if (file == nullptr) {
+	    return false;
+	}
+	// Whole rows of every block are parsed, the rest is moved to the front of the buffer for the next one:
+	std::vector<char> buffer(1 << 20);
+	size_t used = 0;
+	bool good = true;
+	while (good) {
+	    if (used == buffer.size()) {
+		buffer.resize(2 * buffer.size());	// A row longer than the buffer
+	    }
+	    size_t read = std::fread(buffer.data() + used, 1, buffer.size() - used, file);
+	    used += read;
+	    const char* end = buffer.data() + used;
+	    const char* p = buffer.data();
+	    for (const char* eol; good && (eol = static_cast<const char*>(std::memchr(p, '\n', end - p))) != nullptr; p = eol + 1) {
+		good = parseRow(p, eol);
+	    }
+	    if (read == 0) {
+		if (good && p < end) {
+		    good = parseRow(p, end);
+		}
+		break;
+	    }
+	    used = end - p;
+	    std::memmove(buffer.data(), p, used);
+	}
+	std::fclose(file);
+	return good;
+    }
+}
+
+Geometry::BoundaryLoops::BoundaryLoops(SampledBoundary _loops)
+{
+    auto storage = std::make_shared<const SampledBoundary>(std::move(_loops));
+    for (const PointVector& loop : *storage) {
+	loops.emplace_back(loop);
+    }
+    owner = std::move(storage);
+}
+
+size_t Geometry::BoundaryLoops::size() const
+{
+    return loops.size();
+}
+
+bool Geometry::BoundaryLoops::empty() const
+{
+    return loops.empty();
+}
+
+std::span<const Geometry::Point3D> Geometry::BoundaryLoops::operator[](size_t i) const
+{
+    return loops[i];
+}
+
+Geometry::SampledBoundary Geometry::readSampledBoundary(const std::string& filename)
+{
+    SampledBoundary loops;
+    bool newLoop = true;
+    size_t number = 0;
+    bool good = forEachRow(filename, [&](const char* p, const char* end) {
+	number++;
+	if (atEnd(p, end)) {
+	    newLoop = true;
+	    return true;
+	}
+	double x, y, h;
+	const char* row = p;
+	if (!parseNumber(p, end, x) || !parseNumber(p, end, y) || !parseNumber(p, end, h) || !atEnd(p, end)) {
+	    while (isBlank(*row)) {
+		row++;
+	    }
+	    return *row == '#';		// A comment
+	}
+	if (newLoop) {
+	    loops.emplace_back();
+	    newLoop = false;
+	}
+	loops.back().push_back(Point3D(x, y, h));
+	return true;
+    });
+    if (!good && number > 0) {
+	throw std::invalid_argument(filename + ":" + std::to_string(number) + ": expected \"x y height\"");
+    }
+    return loops;
+}
+
+Geometry::SampledBoundary Geometry::readCSVBoundary(const std::string& filename)
+{
+    SampledBoundary loops;
+    std::unordered_map<long long, size_t> loopIndex;
+    long long lastId = 0;
+    size_t last = 0;
+    size_t number = 0;
+    bool good = forEachRow(filename, [&](const char* p, const char* end) {
+	number++;
+	if (atEnd(p, end)) {
+	    return true;
+	}
+	long long id;
+	double x, y, h;
+	if (!parseNumber(p, end, id) || !parseSeparator(p, end, ',') || !parseNumber(p, end, x) || !parseSeparator(p, end, ',')
+	    || !parseNumber(p, end, y) || !parseSeparator(p, end, ',') || !parseNumber(p, end, h) || !atEnd(p, end)) {
+	    return number == 1;		// The header row
+	}
+	if (loops.empty() || id != lastId) {
+	    auto [it, inserted] = loopIndex.try_emplace(id, loops.size());
+	    if (inserted) {
+		loops.emplace_back();
+	    }
+	    lastId = id;
+	    last = it->second;
+	}
+	loops[last].push_back(Point3D(x, y, h));
+	return true;
+    });
+    if (!good && number > 0) {
+	throw std::invalid_argument(filename + ":" + std::to_string(number) + ": expected \"loop,x,y,height\"");
+    }
+    return loops;
+}
+
+Geometry::BoundaryLoops Geometry::readBinaryBoundary(const std::string& filename)
+{
+    BoundaryLoops result;
+    auto file = std::make_shared<const MappedFile>(filename);
+    if (file->data() == nullptr) {
+	return result;
+    }
+    auto invalid = [&](const char* reason) { return std::invalid_argument(filename + ": " + reason); };
+    const char* data = file->data();
+    const size_t size = file->size();
+    constexpr size_t headerSize = 16;
+    if (size < headerSize || std::memcmp(data, binaryMagic, sizeof(binaryMagic)) != 0) {
+	throw invalid("not a binary boundary file");
+    }
+    uint32_t version;
+    uint64_t loopCount;
+    std::memcpy(&version, data + 4, sizeof(version));
+    std::memcpy(&loopCount, data + 8, sizeof(loopCount));
+    if (version != binaryVersion) {
+	throw invalid("unsupported binary boundary version");
+    }
+    if (loopCount > (size - headerSize) / sizeof(uint64_t)) {
+	throw invalid("truncated loop table");
+    }
+    const uint64_t* counts = reinterpret_cast<const uint64_t*>(data + headerSize);
+    size_t offset = headerSize + loopCount * sizeof(uint64_t);
+    uint64_t sampleCount = 0;
+    for (uint64_t l = 0; l < loopCount; l++) {
+	if (counts[l] > (size - offset) / sizeof(Point3D) - sampleCount) {
+	    throw invalid("truncated samples");
+	}
+	sampleCount += counts[l];
+    }
+    if (offset + sampleCount * sizeof(Point3D) != size) {
+	throw invalid("trailing data");
+    }
+    const Point3D* samples = reinterpret_cast<const Point3D*>(data + offset);
+    for (uint64_t l = 0; l < loopCount; l++) {
+	result.loops.emplace_back(samples, counts[l]);
+	samples += counts[l];
+    }
+    result.owner = std::move(file);
+    return result;
+}
+
+bool Geometry::writeBinaryBoundary(const std::string& filename, const SampledBoundary& loops)
+{
+    BufferedWriter writer(filename.c_str());
+    uint64_t loopCount = loops.size();
+    writer.write(binaryMagic, sizeof(binaryMagic));
+    writer.write(&binaryVersion, sizeof(binaryVersion));
+    writer.write(&loopCount, sizeof(loopCount));
+    for (const PointVector& loop : loops) {
+	uint64_t count = loop.size();
+	writer.write(&count, sizeof(count));
+    }
+    for (const PointVector& loop : loops) {
+	writer.write(loop.data(), loop.size() * sizeof(Point3D));
+    }
+    writer.flush();
+    return writer.good();
+}
+
+Geometry::BoundaryLoops Geometry::readBoundary(const std::string& filename)
+{
+    auto hasExtension = [&](const char* extension) {
+	size_t length = std::strlen(extension);
+	return filename.size() >= length && filename.compare(filename.size() - length, length, extension) == 0;
+    };
+    if (hasExtension(".bin")) {
+	return readBinaryBoundary(filename);
+    }
+    if (hasExtension(".csv")) {
+	return BoundaryLoops(readCSVBoundary(filename));
+    }
+    return BoundaryLoops(readSampledBoundary(filename));
+}
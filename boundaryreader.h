@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "geometry.hh"
+
+namespace Geometry {
+
+  /*
+   * Boundary loops sampled as points (x, y, height): the outer loop first, then the inner ones
+   * (for the sampled constructor and addInnerLoop of ModifiedGordonWixomSurface).
+  */
+  using SampledBoundary = std::vector<PointVector>;
+
+  /*
+   * Loaded boundary loops as views of their samples, together with the storage they point into: the memory mapping of
+   * a binary boundary file (read in place, without copying or parsing) or the parsed loops of other formats.
+   * Copies share the storage, which lives as long as any of them.
+  */
+  class BoundaryLoops
+  {
+  public:
+    BoundaryLoops() = default;
+
+    explicit BoundaryLoops(SampledBoundary loops);
+
+    size_t size() const;
+
+    bool empty() const;
+
+    std::span<const Point3D> operator[](size_t i) const;
+
+  private:
+    friend BoundaryLoops readBinaryBoundary(const std::string& filename);
+
+    std::shared_ptr<const void> owner;	// The MappedFile or the SampledBoundary the loops point into
+    std::vector<std::span<const Point3D>> loops;
+  };
+
+  /*
+   * Reads a text file with one sample "x y height" per line; empty lines separate the loops and lines starting with #
+   * are comments. Returns no loops if the file cannot be opened, and throws std::invalid_argument on a malformed line.
+  */
+  SampledBoundary readSampledBoundary(const std::string& filename);
+
+  /*
+   * Reads a CSV file with the rows "loop,x,y,height" (and an optional header row), streamed in blocks.
+   * Rows with the same loop id form a loop, in the order of its samples; loops are ordered by their first row.
+   * Returns no loops if the file cannot be opened, and throws std::invalid_argument on a malformed row.
+  */
+  SampledBoundary readCSVBoundary(const std::string& filename);
+
+  /*
+   * Maps a binary boundary file (native byte order, all fields 8-byte aligned):
+   *   char magic[4] = "PHBL", uint32 version = 1, uint64 loop count L,
+   *   uint64 sample count of each of the L loops,
+   *   the samples of all loops in order, as doubles x, y, height.
+   * Returns no loops if the file cannot be opened, and throws std::invalid_argument if it is not such a file.
+  */
+  BoundaryLoops readBinaryBoundary(const std::string& filename);
+
+  bool writeBinaryBoundary(const std::string& filename, const SampledBoundary& loops);
+
+  /*
+   * Reads a boundary file by its extension: .bin (binary), .csv, or anything else as text.
+  */
+  BoundaryLoops readBoundary(const std::string& filename);
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+
+#include "geometry.hh"
+
+// Algorithm numbers refer to Piegl & Tiller: The NURBS Book, 2nd edition.
+
+namespace Geometry {
+
+BSBasis::BSBasis()
+  : p_(0) {
+}
+
+BSBasis::BSBasis(size_t degree, const DoubleVector &knots)
+  : p_(degree), knots_(knots) {
+}
+
+size_t
+BSBasis::degree() const {
+  return p_;
+}
+
+void
+BSBasis::setDegree(size_t degree) {
+  p_ = degree;
+}
+
+const DoubleVector &
+BSBasis::knots() const {
+  return knots_;
+}
+
+DoubleVector &
+BSBasis::knots() {
+  return knots_;
+}
+
+double
+BSBasis::low() const {
+  return knots_[p_];
+}
+
+double
+BSBasis::high() const {
+  return knots_[knots_.size() - p_ - 1];
+}
+
+void
+BSBasis::reverse() {
+  // u -> front + back - u, keeping the knots ascending
+  size_t k = knots_.size();
+  DoubleVector reversed(k);
+  for (size_t i = 0; i < k; ++i)
+    reversed[i] = knots_.front() + knots_.back() - knots_[k - i - 1];
+  knots_ = reversed;
+}
+
+void
+BSBasis::normalize() {
+  // [low, high] -> [0, 1]
+  double from = low(), length = high() - low();
+  for (auto &k : knots_)
+    k = (k - from) / length;
+}
+
+size_t
+BSBasis::findSpan(double u) const {
+  // A2.1, with the span of the last non-empty interval at the upper end
+  size_t n = knots_.size() - p_ - 2;
+  if (u >= knots_[n + 1])
+    return n;
+  if (u <= knots_[p_])
+    return p_;
+  return std::upper_bound(knots_.begin() + p_ + 1, knots_.begin() + n + 1, u) - knots_.begin() - 1;
+}
+
+size_t
+BSBasis::findSpanWithMultiplicity(double u, size_t &multi) const {
+  size_t span = findSpan(u);
+  multi = 0;
+  for (size_t i = span + 1; i > 0 && knots_[i - 1] == u; --i)
+    ++multi;
+  return span;
+}
+
+void
+BSBasis::basisFunctions(size_t i, double u, DoubleVector &coeff) const {
+  // A2.2
+  coeff.clear(); coeff.reserve(p_ + 1);
+  coeff.push_back(1.0);
+  DoubleVector left(p_ + 1), right(p_ + 1);
+  for (size_t j = 1; j <= p_; ++j) {
+    left[j] = u - knots_[i + 1 - j];
+    right[j] = knots_[i + j] - u;
+    double saved = 0.0;
+    for (size_t r = 0; r < j; ++r) {
+      double tmp = coeff[r] / (right[r + 1] + left[j - r]);
+      coeff[r] = saved + tmp * right[r + 1];
+      saved = tmp * left[j - r];
+    }
+    coeff.push_back(saved);
+  }
+}
+
+void
+BSBasis::basisFunctionsAll(size_t i, double u, DoubleMatrix &coeff) const {
+  // coeff[j] holds the nonzero basis functions of degree j (j + 1 of them), as in A2.2
+  coeff.clear(); coeff.resize(p_ + 1);
+  coeff[0].push_back(1.0);
+  DoubleVector left(p_ + 1), right(p_ + 1);
+  for (size_t j = 1; j <= p_; ++j) {
+    coeff[j].reserve(j + 1);
+    left[j] = u - knots_[i + 1 - j];
+    right[j] = knots_[i + j] - u;
+    double saved = 0.0;
+    for (size_t r = 0; r < j; ++r) {
+      double tmp = coeff[j - 1][r] / (right[r + 1] + left[j - r]);
+      coeff[j].push_back(saved + tmp * right[r + 1]);
+      saved = tmp * left[j - r];
+    }
+    coeff[j].push_back(saved);
+  }
+}
+
+void
+BSBasis::basisFunctionDerivatives(size_t i, double u, size_t nr_der, DoubleMatrix &coeff) const {
+  // A2.3; coeff[k][j] is the k-th derivative of the j-th nonzero basis function
+  coeff.clear(); coeff.resize(nr_der + 1);
+  for (auto &c : coeff)
+    c.resize(p_ + 1, 0.0);
+  DoubleVector left(p_ + 1), right(p_ + 1);
+  DoubleMatrix ndu(p_ + 1, DoubleVector(p_ + 1));
+  ndu[0][0] = 1.0;
+  for (size_t j = 1; j <= p_; ++j) {
+    left[j] = u - knots_[i + 1 - j];
+    right[j] = knots_[i + j] - u;
+    double saved = 0.0;
+    for (size_t r = 0; r < j; ++r) {
+      // lower triangle
+      ndu[j][r] = right[r + 1] + left[j - r];
+      double tmp = ndu[r][j - 1] / ndu[j][r];
+      // upper triangle
+      ndu[r][j] = saved + tmp * right[r + 1];
+      saved = tmp * left[j - r];
+    }
+    ndu[j][j] = saved;
+  }
+  for (size_t j = 0; j <= p_; ++j)
+    coeff[0][j] = ndu[j][p_];
+  DoubleMatrix a(2, DoubleVector(p_ + 1));
+  for (size_t r = 0; r <= p_; ++r) {
+    size_t s1 = 0, s2 = 1;
+    a[0][0] = 1.0;
+    for (size_t k = 1; k <= nr_der && k <= p_; ++k) {
+      double d = 0.0;
+      size_t rk = r - k, pk = p_ - k;
+      if (r >= k) {
+        a[s2][0] = a[s1][0] / ndu[pk + 1][rk];
+        d = a[s2][0] * ndu[rk][pk];
+      }
+      size_t j1 = r + 1 >= k ? 1 : k - r;
+      size_t j2 = (r == 0 || r - 1 <= pk) ? k - 1 : p_ - r;
+      for (size_t j = j1; j <= j2; ++j) {
+        a[s2][j] = (a[s1][j] - a[s1][j - 1]) / ndu[pk + 1][rk + j];
+        d += a[s2][j] * ndu[rk + j][pk];
+      }
+      if (r <= pk) {
+        a[s2][k] = -a[s1][k - 1] / ndu[pk + 1][r];
+        d += a[s2][k] * ndu[r][pk];
+      }
+      coeff[k][r] = d;
+      std::swap(s1, s2);
+    }
+  }
+  size_t r = p_;
+  for (size_t k = 1; k <= nr_der && k <= p_; ++k) {
+    for (size_t j = 0; j <= p_; ++j)
+      coeff[k][j] *= r;
+    r *= p_ - k;
+  }
+}
+
+} // namespace Geometry
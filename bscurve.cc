@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+#include "geometry.hh"
+
+// Algorithm numbers refer to Piegl & Tiller: The NURBS Book, 2nd edition.
+
+namespace Geometry {
+
+namespace {
+
+// Splits the Bernstein coefficients c[0..p] of [0, 1] at t into those of [0, t] and [t, 1] (de Casteljau).
+// Coefficients are a std::array for low degrees, to avoid allocations in the root finding below, or a DoubleVector.
+template <typename Coefficients>
+void
+splitBernstein(const Coefficients &c, size_t p, double t, Coefficients &left, Coefficients &right) {
+  Coefficients tmp = c;
+  for (size_t k = 0; k <= p; ++k) {
+    left[k] = tmp[0];
+    right[p - k] = tmp[p - k];
+    for (size_t i = 0; i + k < p; ++i)
+      tmp[i] = tmp[i] * (1.0 - t) + tmp[i + 1] * t;
+  }
+}
+
+// Roots of the polynomial with Bernstein coefficients c[0..p] over [a, b], by Bezier clipping: the convex hull of the
+// control points (i / p, c_i) only meets the axis where roots are possible, so the curve is clipped to that interval, and
+// split in half when this does not shrink it enough (several roots). Polynomials without a sign change in c are culled at once.
+template <typename Coefficients>
+void
+bernsteinRoots(const Coefficients &c, size_t p, double a, double b, DoubleVector &roots, size_t depth = 0) {
+  bool positive = true, negative = true;
+  for (size_t i = 0; i <= p; ++i) {
+    positive = positive && c[i] > 0.0;
+    negative = negative && c[i] < 0.0;
+  }
+  if (positive || negative || p == 0)
+    return;
+
+  double lo = 1.0, hi = 0.0;
+  for (size_t i = 0; i <= p; ++i) {
+    if (c[i] == 0.0) {
+      lo = std::min(lo, static_cast<double>(i) / p);
+      hi = std::max(hi, static_cast<double>(i) / p);
+    }
+    for (size_t j = i + 1; j <= p; ++j)
+      if (c[i] * c[j] < 0.0) {
+        double t = (i + (j - i) * c[i] / (c[i] - c[j])) / p;
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+      }
+  }
+  if (lo > hi)
+    return;
+
+  double tolerance = 4.0 * std::numeric_limits<double>::epsilon() * (std::abs(a) + std::abs(b) + 1.0);
+  if ((b - a) * (hi - lo) <= tolerance || depth > 64) {
+    roots.push_back(a + (b - a) * (lo + hi) / 2.0);
+    return;
+  }
+  Coefficients left = c, right = c;
+  if (hi - lo > 0.8) {
+    splitBernstein(c, p, 0.5, left, right);
+    double m = (a + b) / 2.0;
+    bernsteinRoots(left, p, a, m, roots, depth + 1);
+    bernsteinRoots(right, p, m, b, roots, depth + 1);
+  } else {
+    Coefficients unused = c;
+    splitBernstein(c, p, hi, left, unused);
+    splitBernstein(left, p, hi > 0.0 ? lo / hi : 0.0, unused, right);
+    bernsteinRoots(right, p, a + (b - a) * lo, a + (b - a) * hi, roots, depth + 1);
+  }
+}
+
+} // namespace
+
+BSCurve::BSCurve()
+  : n_(0) {
+}
+
+BSCurve::BSCurve(const PointVector &cpts)
+  : n_(cpts.size() - 1), cp_(cpts) {
+  // Bezier curve over [0, 1]
+  DoubleVector knots(n_ + 1, 0.0);
+  knots.resize(2 * (n_ + 1), 1.0);
+  basis_ = BSBasis(n_, knots);
+}
+
+BSCurve::BSCurve(size_t degree, const DoubleVector &knots, const PointVector &cpts)
+  : n_(cpts.size() - 1), basis_(degree, knots), cp_(cpts) {
+}
+
+Point3D
+BSCurve::eval(double u) const {
+  size_t p = basis_.degree();
+  size_t span = basis_.findSpan(u);
+  DoubleVector coeff;
+  basis_.basisFunctions(span, u, coeff);
+  Point3D point(0.0, 0.0, 0.0);
+  for (size_t j = 0; j <= p; ++j)
+    point += cp_[span - p + j] * coeff[j];
+  return point;
+}
+
+Point3D
+BSCurve::eval(double u, size_t nr_der, VectorVector &der) const {
+  // A3.2
+  size_t p = basis_.degree();
+  size_t du = std::min(nr_der, p);
+  der.clear();
+  der.resize(nr_der + 1, Vector3D(0.0, 0.0, 0.0));
+  size_t span = basis_.findSpan(u);
+  DoubleMatrix nder;
+  basis_.basisFunctionDerivatives(span, u, du, nder);
+  for (size_t k = 0; k <= du; ++k)
+    for (size_t j = 0; j <= p; ++j)
+      der[k] += cp_[span - p + j] * nder[k][j];
+  return der[0];
+}
+
+const PointVector &
+BSCurve::controlPoints() const {
+  return cp_;
+}
+
+PointVector &
+BSCurve::controlPoints() {
+  return cp_;
+}
+
+const BSBasis &
+BSCurve::basis() const {
+  return basis_;
+}
+
+void
+BSCurve::reverse() {
+  basis_.reverse();
+  std::reverse(cp_.begin(), cp_.end());
+}
+
+void
+BSCurve::normalize() {
+  basis_.normalize();
+}
+
+double
+BSCurve::arcLength(double from, double to) const {
+  // 5-point Gauss-Legendre quadrature on every knot interval within [from, to]
+  static const double nodes[] = { 0.0, -0.5384693101056831, 0.5384693101056831, -0.9061798459386640, 0.9061798459386640 };
+  static const double weights[] = { 0.5688888888888889, 0.4786286704993665, 0.4786286704993665,
+                                    0.2369268850561891, 0.2369268850561891 };
+  const auto &knots = basis_.knots();
+  double length = 0.0;
+  VectorVector der;
+  for (size_t i = basis_.degree(); i + basis_.degree() + 1 < knots.size(); ++i) {
+    double a = std::max(from, knots[i]), b = std::min(to, knots[i + 1]);
+    if (a >= b)
+      continue;
+    for (size_t j = 0; j < 5; ++j) {
+      eval((a + b) / 2.0 + nodes[j] * (b - a) / 2.0, 1, der);
+      length += weights[j] * der[1].norm() * (b - a) / 2.0;
+    }
+  }
+  return length;
+}
+
+BSCurve
+BSCurve::insertKnot(double u, size_t r) const {
+  const auto &knots = basis_.knots();
+  size_t k = std::upper_bound(knots.begin(), knots.end(), u) - knots.begin() - 1;
+  size_t s = std::count(knots.begin(), knots.end(), u);
+  if (s >= basis_.degree())
+    return *this;
+  return insertKnot(u, k, s, std::min(r, basis_.degree() - s));
+}
+
+BSCurve
+BSCurve::insertKnot(double u, size_t k, size_t s, size_t r) const {
+  // A5.1; u is inserted r times into [knots[k], knots[k + 1]), where it already has multiplicity s
+  size_t p = basis_.degree();
+  const auto &UP = basis_.knots();
+  DoubleVector UQ(UP.size() + r);
+  PointVector Q(n_ + 1 + r);
+  for (size_t i = 0; i <= k; ++i)
+    UQ[i] = UP[i];
+  for (size_t i = 1; i <= r; ++i)
+    UQ[k + i] = u;
+  for (size_t i = k + 1; i < UP.size(); ++i)
+    UQ[i + r] = UP[i];
+  for (size_t i = 0; i + p <= k; ++i)
+    Q[i] = cp_[i];
+  for (size_t i = k - s; i <= n_; ++i)
+    Q[i + r] = cp_[i];
+  PointVector R(p - s + 1);
+  for (size_t i = 0; i <= p - s; ++i)
+    R[i] = cp_[k - p + i];
+  size_t L = k - p;
+  for (size_t j = 1; j <= r; ++j) {
+    L = k - p + j;
+    for (size_t i = 0; i + j + s <= p; ++i) {
+      double alpha = (u - UP[L + i]) / (UP[i + k + 1] - UP[L + i]);
+      R[i] = R[i + 1] * alpha + R[i] * (1.0 - alpha);
+    }
+    Q[L] = R[0];
+    Q[k + r - j - s] = R[p - j - s];
+  }
+  for (size_t i = L + 1; i + s < k; ++i)
+    Q[i] = R[i - L];
+  return BSCurve(p, UQ, Q);
+}
+
+std::vector<BSCurve>
+BSCurve::bezierSegments() const {
+  // Every breakpoint in [low, high] gets multiplicity p, then the p + 1 control points active on a knot interval
+  // are the Bezier points of that piece.
+  size_t p = basis_.degree();
+  double low = basis_.low(), high = basis_.high();
+  BSCurve curve = *this;
+  DoubleVector breaks;
+  for (double u : basis_.knots())
+    if (u >= low && u <= high && (breaks.empty() || breaks.back() != u))
+      breaks.push_back(u);
+  for (double u : breaks)
+    curve = curve.insertKnot(u, p);
+
+  std::vector<BSCurve> segments;
+  const auto &knots = curve.basis_.knots();
+  for (size_t i = 0; i + 1 < breaks.size(); ++i) {
+    size_t k = std::upper_bound(knots.begin(), knots.end(), breaks[i]) - knots.begin() - 1;
+    PointVector cpts(curve.cp_.begin() + (k - p), curve.cp_.begin() + (k + 1));
+    DoubleVector bezier_knots(p + 1, breaks[i]);
+    bezier_knots.resize(2 * (p + 1), breaks[i + 1]);
+    segments.emplace_back(p, bezier_knots, cpts);
+  }
+  return segments;
+}
+
+DoubleVector
+BSCurve::intersectWithPlane(const Point3D &p, const Vector3D &n) const {
+  // Bezier clipping on each polynomial piece, with the signed distances of the control points as Bernstein coefficients.
+  size_t deg = basis_.degree();
+  bool bezier = basis_.knots().size() == 2 * (deg + 1);
+  std::vector<BSCurve> pieces;
+  if (!bezier)
+    pieces = bezierSegments();
+  DoubleVector result;
+  std::array<double, 16> small;
+  DoubleVector large(deg < small.size() ? 0 : deg + 1);
+  for (size_t i = 0; i < (bezier ? 1 : pieces.size()); ++i) {
+    const BSCurve &piece = bezier ? *this : pieces[i];
+    double low = piece.basis_.low(), high = piece.basis_.high();
+    if (deg < small.size()) {
+      for (size_t j = 0; j <= deg; ++j)
+        small[j] = (piece.cp_[j] - p) * n;
+      bernsteinRoots(small, deg, low, high, result);
+    } else {
+      for (size_t j = 0; j <= deg; ++j)
+        large[j] = (piece.cp_[j] - p) * n;
+      bernsteinRoots(large, deg, low, high, result);
+    }
+  }
+
+  // Roots at breakpoints are found on both sides.
+  std::sort(result.begin(), result.end());
+  double tolerance = 1.0e-12 * (basis_.high() - basis_.low());
+  result.erase(std::unique(result.begin(), result.end(),
+                           [=](double a, double b) { return b - a <= tolerance; }),
+               result.end());
+  return result;
+}
+
+} // namespace Geometry
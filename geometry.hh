@@ -2,8 +2,10 @@
 
 #include <array>
 #include <iostream>
-#include <list>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <string>
 #include <vector>
 
 namespace Geometry {
@@ -205,7 +207,8 @@ public:
   // Other
   double arcLength(double from, double to) const;
   BSCurve insertKnot(double u, size_t r) const;
-  DoubleVector intersectWithPlane(const Point3D &p, const Vector3D &n) const;
+  std::vector<BSCurve> bezierSegments() const; // one Bezier curve per non-empty knot interval
+  DoubleVector intersectWithPlane(const Point3D &p, const Vector3D &n) const; // sorted parameters
 
 private:
   BSCurve insertKnot(double u, size_t k, size_t s, size_t r) const;
@@ -259,32 +262,75 @@ private:
 
 class TriMesh {
 public:
-  using Triangle = std::array<size_t, 3>;
+  // Same layout as the index arrays of Triangle (triangulateio::trianglelist), so those can be adopted.
+  using Triangle = std::array<int, 3>;
+
+  // Constructors
+  TriMesh() = default;
+  TriMesh(const TriMesh &other);
+  TriMesh(TriMesh &&other) noexcept;
+  TriMesh &operator=(const TriMesh &other);
+  TriMesh &operator=(TriMesh &&other) noexcept;
 
   // Mesh building
   void clear();
   void resizePoints(size_t n);
   void setPoints(const PointVector &pv);
   void addTriangle(size_t a, size_t b, size_t c);
-  void setTriangles(const std::list<Triangle> &tl);
+  void setTriangles(const std::vector<Triangle> &tl);
+  void adoptTriangles(int *indices, size_t n); // takes ownership of a malloc'd array of 3n indices
   TriMesh &append(const TriMesh &other);
+  // Appends other, welding each of its vertices to the nearest vertex within tolerance (of this mesh, or
+  // an earlier one of other); triangles that collapse are dropped. Linear time, via spatial hashing.
   TriMesh &insert(const TriMesh &other, double tolerance);
+  // Splits every triangle into four at its edge midpoints, keeping the orientation. The midpoints are appended
+  // (normals, if any, are averaged), so the existing vertices keep their indices.
+  TriMesh &subdivide();
+
+  // Per-vertex normals (optional, empty or one per point)
+  const VectorVector &normals() const;
+  VectorVector &normals();
 
   // I/O
   Point3D &operator[](size_t i);
   const Point3D &operator[](size_t i) const;
   const PointVector &points() const;
-  const std::list<Triangle> &triangles() const;
+  std::span<const Triangle> triangles() const;
+  std::span<Triangle> triangles();
   static TriMesh readOBJ(std::string filename);
-  void writeOBJ(std::string filename) const;
-  void writeSTL(std::string filename) const;
-
+  bool writeOBJ(std::string filename, int precision = 6) const;
+  bool writeSTL(std::string filename) const; // binary
+  bool writePLY(std::string filename) const; // binary little-endian
+
+  // Closest point queries, accelerated by a bounding volume hierarchy that is built on the first query
+  // (thread-safe) and dropped by the mesh building functions. After moving points through operator[]
+  // or triangles(), call invalidateBVH().
+  struct Projection {
+    size_t triangle;                    // index into triangles()
+    Point3D point;                      // closest point of the mesh
+    std::array<double, 3> barycentric; // of point, w.r.t. the corners of the triangle
+    double distance;
+  };
   const Triangle &closestTriangle(const Point3D &p) const;
   Point3D projectToTriangle(const Point3D &p, const Triangle &tri) const;
+  Projection project(const Point3D &p) const;
+  std::vector<Projection> project(const PointVector &pv) const; // in parallel
+  void invalidateBVH();
 
 private:
+  struct FreeDeleter {
+    void operator()(void *p) const;
+  };
+  struct BVH;
+  void reserveTriangles(size_t n);
+  std::shared_ptr<const BVH> bvh() const;
+
   PointVector points_;
-  std::list<Triangle> triangles_;
+  VectorVector normals_;
+  std::unique_ptr<Triangle[], FreeDeleter> triangles_; // malloc'd, to be able to adopt Triangle's output
+  size_t n_triangles_ = 0, capacity_ = 0;
+  mutable std::shared_ptr<const BVH> bvh_;
+  mutable std::mutex bvh_mutex_;
 };
 
 } // namespace Geometry
@@ -0,0 +1,289 @@
+#include "geometrywriter.h"
+#include "meshreorder.h"
+#include "parallel.h"
+#include "polarmesh.h"
+#include "sizingfield.h"
+#include "triangulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+void evaluate_heights(const Geometry::ModifiedGordonWixomSurface& surface, Geometry::TriMesh& mesh, bool normals, HeightAxis axis,
+		      size_t first) {
+	const int h = (axis == HeightAxis::Y) ? 1 : 2;	// Coordinate receiving the height
+	const int y = (axis == HeightAxis::Y) ? 2 : 1;	// Second planar coordinate
+
+	// Orient the normals like the faces: the surface normal (x, y, u(x, y)) is (-u_x, -u_y, 1) for counterclockwise faces in the plane.
+	double orientation = 1.0;
+	if (normals) {
+		double signedArea = 0.0;
+		for (const auto& t : mesh.triangles()) {
+			const Geometry::Point3D& a = mesh[t[0]];
+			const Geometry::Point3D& b = mesh[t[1]];
+			const Geometry::Point3D& c = mesh[t[2]];
+			signedArea += (b[0] - a[0]) * (c[y] - a[y]) - (b[y] - a[y]) * (c[0] - a[0]);
+		}
+		// In the (x, z) plane the axes are swapped relative to (x, y, height), flipping the orientation.
+		orientation = ((signedArea < 0.0) ? -1.0 : 1.0) * ((axis == HeightAxis::Y) ? -1.0 : 1.0);
+		mesh.normals().resize(mesh.points().size());
+	}
+
+	Geometry::parallelFor(mesh.points().size() - std::min(first, mesh.points().size()), [&](size_t k) {
+		const size_t i = first + k;
+		Geometry::Point3D& v = mesh[i];
+		Geometry::Point2D p(v[0], v[y]);
+		if (normals) {
+			auto [u, gradient] = surface.evalWithGradient(p);
+			v[h] = u;
+			Geometry::Vector3D normal;
+			normal[0] = -gradient[0];
+			normal[y] = -gradient[1];
+			normal[h] = 1.0;
+			mesh.normals()[i] = normal.normalize() * orientation;
+		}
+		else {
+			v[h] = surface.eval(p);
+		}
+	});
+}
+
+bool reevaluate_geometry(const Geometry::ModifiedGordonWixomSurface& surface, const char* input, const char* output,
+			 const GeometryOptions& options, HeightAxis axis) {
+	Geometry::TriMesh mesh = Geometry::TriMesh::readOBJ(input);
+	if (mesh.points().empty()) {
+		std::cout << "Reading " << input << " failed." << std::endl;
+		return false;
+	}
+	evaluate_heights(surface, mesh, options.normals, axis);
+	if (!write_mesh(mesh, output, options)) {
+		std::cout << "Writing " << output << " failed." << std::endl;
+		return false;
+	}
+	if (options.verbose) {
+		std::cout << "Writing " << output << " is finished." << std::endl;
+	}
+	return true;
+}
+
+bool write_mesh(const Geometry::TriMesh& mesh, const char* filename, const GeometryOptions& options) {
+	switch (options.format) {
+	case MeshFormat::OBJ:
+		return mesh.writeOBJ(filename, options.precision);
+	case MeshFormat::PLY:
+		return mesh.writePLY(filename);
+	case MeshFormat::STL:
+		return mesh.writeSTL(filename);
+	}
+	return false;
+}
+
+namespace {
+
+// A point strictly inside the closed polygon: the middle of the widest inside span of a horizontal line halfway up.
+Geometry::Point2D interior_point(const std::vector<Geometry::Point2D>& polygon) {
+	double low = polygon[0][1], high = low;
+	for (const Geometry::Point2D& p : polygon) {
+		low = std::min(low, p[1]);
+		high = std::max(high, p[1]);
+	}
+	const double y = (low + high) / 2;
+	std::vector<double> crossings;
+	for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+		if ((polygon[i][1] > y) != (polygon[j][1] > y)) {
+			crossings.push_back(polygon[i][0] + (polygon[j][0] - polygon[i][0]) * (y - polygon[i][1]) / (polygon[j][1] - polygon[i][1]));
+		}
+	}
+	std::sort(crossings.begin(), crossings.end());
+	Geometry::Point2D best((polygon[0][0] + polygon[polygon.size() / 2][0]) / 2, y);
+	double width = 0.0;
+	for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+		if (crossings[i + 1] - crossings[i] > width) {
+			width = crossings[i + 1] - crossings[i];
+			best = Geometry::Point2D((crossings[i] + crossings[i + 1]) / 2, y);
+		}
+	}
+	return best;
+}
+
+// Triangulates the domain bounded by the surface's discretized loops as selected by the options; scale multiplies
+// the maximal triangle area (and the adaptive tolerance, as the interpolation error grows about linearly with the area).
+Geometry::TriMesh triangulate_domain(const Geometry::ModifiedGordonWixomSurface& surface, const GeometryOptions& options,
+				     double scale = 1.0) {
+	std::vector<Geometry::Point2D> discretizedCurve = surface.getDiscretizedCurve();
+
+	size_t n = discretizedCurve.size();	// # of points
+	if (options.verbose) {
+		std::cout << "Number of curve points: " << n << std::endl;
+	}
+	std::vector<double> points;
+	points.reserve(n * 2);
+	for (size_t i = 0; i < n; i++) {
+		points.push_back(discretizedCurve[i][0]);
+		points.push_back(discretizedCurve[i][1]);
+	}
+
+	// Inner loops follow the outer curve, each with a seed point that Triangle removes the triangles around.
+	std::vector<Geometry::Point2D> boundary = discretizedCurve;	// All loops, as the cache key
+	std::vector<size_t> loopStart(1, 0);
+	std::vector<double> holes;
+	std::string loopSizes;
+	for (size_t l = 1; l < surface.getLoopCount(); l++) {
+		const std::vector<Geometry::Point2D>& loop = surface.getDiscretizedLoop(l);
+		loopStart.push_back(boundary.size());
+		boundary.insert(boundary.end(), loop.begin(), loop.end());
+		for (const Geometry::Point2D& p : loop) {
+			points.push_back(p[0]);
+			points.push_back(p[1]);
+		}
+		Geometry::Point2D seed = interior_point(loop);
+		holes.push_back(seed[0]);
+		holes.push_back(seed[1]);
+		loopSizes += ' ';
+		loopSizes += std::to_string(loop.size());
+	}
+	loopStart.push_back(boundary.size());
+	double max_area = options.maxArea * scale;
+
+  // Call the library function
+  // Look up all the switches to see what they do!
+  std::ostringstream cmd;
+  std::optional<Geometry::SizingField> sizing;
+  if (options.adaptiveTolerance > 0.0) {
+	// Flat regions may be much coarser than the uniform mesh, curved ones a bit finer:
+	sizing.emplace(surface, options.adaptiveTolerance * scale, max_area / 4);
+	cmd << "pqa" << std::fixed << max_area * 16 << "uDBPzQ";
+  }
+  else {
+	cmd << "pqa" << std::fixed << max_area << "DBPzQ";
+  }
+
+	// The adaptive triangulation also depends on the heights, so only uniform ones are cached.
+	Geometry::TriangulationCache* cache = sizing ? nullptr : options.triangulationCache;
+	const std::string key = cmd.str() + loopSizes;
+	Geometry::TriMesh mesh;
+	bool structured = options.structured && !sizing && holes.empty();
+	if (structured && !Geometry::isStarShaped(discretizedCurve, options.center)) {
+		if (options.verbose) {
+			std::cout << "The domain is not star-shaped with respect to the center, using Triangle." << std::endl;
+		}
+		structured = false;
+	}
+	if (structured) {
+		mesh = Geometry::polarMesh(discretizedCurve, options.center, max_area);
+	}
+	else if (cache != nullptr && cache->find(boundary, key, mesh)) {
+		if (options.verbose) {
+			std::cout << "Reusing the cached triangulation." << std::endl;
+		}
+	}
+	else {
+		// Input segments : a closed polygon per loop
+		std::vector<int> segments;
+		segments.reserve(boundary.size() * 2);
+		for (size_t l = 0; l + 1 < loopStart.size(); ++l) {
+			for (size_t i = loopStart[l]; i < loopStart[l + 1]; ++i) {
+				segments.push_back(i);
+				segments.push_back(i + 1);
+			}
+			segments.back() = loopStart[l];
+		}
+
+		Geometry::SizingField::Scope scope(sizing ? &*sizing : nullptr);
+		Geometry::Triangulation triangulation(cmd.str(), points, segments, holes);
+
+		// Hand the triangulation over to a mesh, adopting Triangle's index array without copying:
+		mesh.resizePoints(triangulation.pointCount());
+		for (size_t i = 0; i < triangulation.pointCount(); ++i) {
+			mesh[i] = Geometry::Point3D(triangulation.points()[2 * i], 0.0, triangulation.points()[2 * i + 1]);
+		}
+		mesh.adoptTriangles(triangulation.releaseTriangles(), triangulation.triangleCount());
+
+		if (cache != nullptr) {
+			cache->insert(boundary, key, mesh);
+		}
+	}
+	return mesh;
+}
+
+}
+
+bool write_geometry(const Geometry::ModifiedGordonWixomSurface& surface, const char* filename, const GeometryOptions& options) {
+	Geometry::TriMesh mesh = triangulate_domain(surface, options);
+
+	if (options.reorder) {
+		double before = Geometry::averageCacheMissRatio(mesh);
+		Geometry::reorderVertices(mesh, Geometry::hilbertOrder(mesh.points(), 0, 2));
+		Geometry::optimizeVertexCache(mesh);
+		if (options.verbose) {
+			std::cout << "Vertex cache miss ratio: " << before << " -> " << Geometry::averageCacheMissRatio(mesh) << std::endl;
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	evaluate_heights(surface, mesh, options.normals, HeightAxis::Y);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	if (options.reorder && options.verbose) {
+		std::cout << "Evaluated " << mesh.points().size() << " vertices in " << elapsed.count() << " s ("
+			  << mesh.points().size() / elapsed.count() << " vertices/s)" << std::endl;
+	}
+
+	bool written = write_mesh(mesh, filename, options);
+	if (!written) {
+		std::cout << "Writing " << filename << " failed." << std::endl;
+	}
+	else if (options.verbose) {
+		std::cout << "Writing " << filename << " is finished." << std::endl;
+	}
+	return written;
+}
+
+bool write_geometry_lod(const Geometry::ModifiedGordonWixomSurface& surface, const std::vector<std::string>& filenames,
+			const GeometryOptions& options) {
+	if (filenames.empty()) {
+		return true;
+	}
+	// Each subdivision quarters the triangle areas, so the finest level gets the usual ones.
+	const size_t levels = filenames.size();
+	Geometry::TriMesh mesh = triangulate_domain(surface, options, std::pow(4.0, static_cast<double>(levels - 1)));
+
+	size_t evaluated = 0;
+	bool allWritten = true;
+	for (size_t level = 0; level < levels; level++) {
+		if (level > 0) {
+			mesh.subdivide();
+		}
+		auto start = std::chrono::steady_clock::now();
+		evaluate_heights(surface, mesh, options.normals, HeightAxis::Y, evaluated);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (options.verbose) {
+			std::cout << "Level " << level << ": " << mesh.points().size() << " vertices (" << mesh.points().size() - evaluated
+				  << " evaluated in " << elapsed.count() << " s), " << mesh.triangles().size() << " triangles" << std::endl;
+		}
+		evaluated = mesh.points().size();
+
+		// The next level builds on this vertex order, so only a copy is reordered.
+		bool written;
+		if (options.reorder) {
+			Geometry::TriMesh reordered = mesh;
+			Geometry::reorderVertices(reordered, Geometry::hilbertOrder(reordered.points(), 0, 2));
+			Geometry::optimizeVertexCache(reordered);
+			written = write_mesh(reordered, filenames[level].c_str(), options);
+		}
+		else {
+			written = write_mesh(mesh, filenames[level].c_str(), options);
+		}
+		if (!written) {
+			std::cout << "Writing " << filenames[level] << " failed." << std::endl;
+			allWritten = false;
+		}
+		else if (options.verbose) {
+			std::cout << "Writing " << filenames[level] << " is finished." << std::endl;
+		}
+	}
+	return allWritten;
+}
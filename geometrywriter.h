@@ -0,0 +1,71 @@
+#pragma once
+
+#include "modifiedgordonwixomsurface.h"
+#include "triangulationcache.h"
+
+#include <string>
+#include <vector>
+
+enum class MeshFormat {
+    OBJ,	// Wavefront OBJ text
+    PLY,	// Binary little-endian PLY
+    STL		// Binary STL
+};
+
+/*
+ * Coordinate of the mesh vertices that holds the height; the other two are the planar query point.
+*/
+enum class HeightAxis {
+    Y,	// (x, height, y), as written by write_geometry
+    Z	// (x, y, height)
+};
+
+struct GeometryOptions {
+    MeshFormat format = MeshFormat::OBJ;
+    bool normals = false;	// Write vertex normals, evaluated together with the heights by evalWithGradient.
+    int precision = 6;		// Significant digits of the written coordinates (OBJ only).
+    double adaptiveTolerance = 0.0;	// If positive, refine by the estimated curvature (see SizingField) instead of uniformly,
+					// to this interpolation error relative to the height range.
+    Geometry::TriangulationCache* triangulationCache = nullptr;	// Reuse triangulations of the same boundary (not adaptive ones).
+    bool structured = false;	// Mesh domains that are star-shaped with respect to center by rings and spokes (polarMesh)
+				// instead of Triangle; not combined with adaptiveTolerance.
+    Geometry::Point2D center = Geometry::Point2D(0.0, 0.0);
+    bool reorder = false;		// Sort the vertices along a Hilbert curve and the faces for the vertex cache before evaluation.
+    double maxArea = 0.0025 * 0.611416847148;	// Maximal triangle area of the uniform triangulation
+    bool verbose = true;	// Report progress on std::cout (off for surfaces written concurrently).
+};
+
+/*
+ * Triangulates the domain bounded by the surface's discretized curve and writes the evaluated surface
+ * in the format selected by the options; returns false on I/O errors.
+*/
+bool write_geometry(const Geometry::ModifiedGordonWixomSurface& surface, const char* filename,
+		    const GeometryOptions& options = GeometryOptions());
+
+/*
+ * Writes the surface at several levels of detail in one pass, from the coarsest (filenames[0]) to the finest, which has
+ * the resolution of write_geometry. Only the coarsest level is triangulated (as write_geometry would, with correspondingly
+ * larger triangles); every further level splits each triangle of the previous one into four, and only the new vertices
+ * are evaluated, so all levels together cost about as much as the finest alone. Returns false if a level could not be written.
+*/
+bool write_geometry_lod(const Geometry::ModifiedGordonWixomSurface& surface, const std::vector<std::string>& filenames,
+			const GeometryOptions& options = GeometryOptions());
+
+/*
+ * Writes the mesh in the format selected by the options; returns false on I/O errors.
+*/
+bool write_mesh(const Geometry::TriMesh& mesh, const char* filename, const GeometryOptions& options);
+
+/*
+ * Replaces the height coordinate of every vertex by the surface evaluated at its planar position, in parallel and in place.
+ * With normals, also sets the vertex normals, oriented like the faces.
+ * Vertices before first keep their height (and normal).
+*/
+void evaluate_heights(const Geometry::ModifiedGordonWixomSurface& surface, Geometry::TriMesh& mesh, bool normals, HeightAxis axis,
+		      size_t first = 0);
+
+/*
+ * Reads an OBJ mesh, re-evaluates its heights without re-triangulating and writes it with unchanged connectivity.
+*/
+bool reevaluate_geometry(const Geometry::ModifiedGordonWixomSurface& surface, const char* input, const char* output,
+			 const GeometryOptions& options = GeometryOptions(), HeightAxis axis = HeightAxis::Y);
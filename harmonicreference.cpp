@@ -0,0 +1,190 @@
+#include "harmonicreference.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "triangulation.h"
+
+namespace {
+
+    // Symmetric sparse matrix in compressed row storage.
+    struct SparseMatrix {
+	std::vector<size_t> rowStart;
+	std::vector<size_t> column;
+	std::vector<double> value;
+
+	void multiply(const std::vector<double>& x, std::vector<double>& y) const
+	{
+	    for (size_t i = 0; i + 1 < rowStart.size(); i++) {
+		double sum = 0.0;
+		for (size_t k = rowStart[i]; k < rowStart[i + 1]; k++) {
+		    sum += value[k] * x[column[k]];
+		}
+		y[i] = sum;
+	    }
+	}
+    };
+
+    struct Triplet {
+	size_t row, column;
+	double value;
+    };
+
+    SparseMatrix assemble(std::vector<Triplet>& triplets, size_t n)
+    {
+	std::sort(triplets.begin(), triplets.end(), [](const Triplet& a, const Triplet& b) {
+	    return a.row < b.row || (a.row == b.row && a.column < b.column);
+	});
+	SparseMatrix A;
+	A.rowStart.assign(n + 1, 0);
+	for (size_t k = 0; k < triplets.size(); k++) {
+	    if (k > 0 && triplets[k].row == triplets[k - 1].row && triplets[k].column == triplets[k - 1].column) {
+		A.value.back() += triplets[k].value;
+		continue;
+	    }
+	    A.column.push_back(triplets[k].column);
+	    A.value.push_back(triplets[k].value);
+	    A.rowStart[triplets[k].row + 1]++;
+	}
+	for (size_t i = 0; i < n; i++) {
+	    A.rowStart[i + 1] += A.rowStart[i];
+	}
+	return A;
+    }
+
+    double dot(const std::vector<double>& a, const std::vector<double>& b)
+    {
+	double sum = 0.0;
+	for (size_t i = 0; i < a.size(); i++) {
+	    sum += a[i] * b[i];
+	}
+	return sum;
+    }
+
+    // Jacobi preconditioned conjugate gradient; returns the number of iterations.
+    int solve(const SparseMatrix& A, const std::vector<double>& b, std::vector<double>& x)
+    {
+	size_t n = b.size();
+	std::vector<double> inverseDiagonal(n, 1.0);
+	for (size_t i = 0; i < n; i++) {
+	    for (size_t k = A.rowStart[i]; k < A.rowStart[i + 1]; k++) {
+		if (A.column[k] == i && A.value[k] != 0.0) {
+		    inverseDiagonal[i] = 1.0 / A.value[k];
+		}
+	    }
+	}
+	std::vector<double> r(n), z(n), p(n), Ap(n);
+	A.multiply(x, Ap);
+	for (size_t i = 0; i < n; i++) {
+	    r[i] = b[i] - Ap[i];
+	    z[i] = inverseDiagonal[i] * r[i];
+	}
+	p = z;
+	double rz = dot(r, z);
+	const double tolerance = 1.0e-24 * std::max(dot(b, b), 1.0);
+	int iteration = 0;
+	for (; iteration < 10 * static_cast<int>(n) && dot(r, r) > tolerance; iteration++) {
+	    A.multiply(p, Ap);
+	    double alpha = rz / dot(p, Ap);
+	    for (size_t i = 0; i < n; i++) {
+		x[i] += alpha * p[i];
+		r[i] -= alpha * Ap[i];
+		z[i] = inverseDiagonal[i] * r[i];
+	    }
+	    double rzNext = dot(r, z);
+	    double beta = rzNext / rz;
+	    rz = rzNext;
+	    for (size_t i = 0; i < n; i++) {
+		p[i] = z[i] + beta * p[i];
+	    }
+	}
+	return iteration;
+    }
+}
+
+Benchmark::HarmonicReference Benchmark::solveHarmonicReference(const std::function<Geometry::Point2D(double)>& curve,
+							       const std::function<double(Geometry::Point2D)>& height,
+							       int boundarySamples, double maxArea)
+{
+    std::vector<double> points;
+    std::vector<int> segments;
+    points.reserve(boundarySamples * 2);
+    segments.reserve(boundarySamples * 2);
+    for (int i = 0; i < boundarySamples; i++) {
+	Geometry::Point2D p = curve(i / (double)boundarySamples);
+	points.push_back(p[0]);
+	points.push_back(p[1]);
+	segments.push_back(i);
+	segments.push_back((i + 1) % boundarySamples);
+    }
+
+    // Unlike write_geometry, keep the boundary markers (no -B): they tell the Dirichlet vertices apart.
+    // Triangle reads the area without an exponent, so fine reference meshes need more than the default 6 decimals.
+    std::ostringstream cmd;
+    cmd << "pqa" << std::fixed << std::setprecision(17) << maxArea << "DPzQ";
+    Geometry::Triangulation triangulation(cmd.str(), points, segments);
+    const double* outPoints = triangulation.points();
+    const int* outMarkers = triangulation.pointMarkers();
+    const int* outTriangles = triangulation.triangles();
+
+    HarmonicReference reference;
+    size_t n = triangulation.pointCount();
+    reference.points.reserve(n);
+    reference.values.assign(n, 0.0);
+    reference.isBoundary.resize(n);
+    std::vector<size_t> unknown(n);	// Index among the interior vertices.
+    size_t numberOfUnknowns = 0;
+    for (size_t i = 0; i < n; i++) {
+	reference.points.emplace_back(outPoints[2 * i], outPoints[2 * i + 1]);
+	reference.isBoundary[i] = outMarkers[i] != 0;
+	if (reference.isBoundary[i]) {
+	    reference.values[i] = height(reference.points[i]);
+	}
+	else {
+	    unknown[i] = numberOfUnknowns++;
+	}
+    }
+
+    // Assemble the stiffness matrix of the interior vertices, moving the boundary terms to the right hand side:
+    std::vector<Triplet> triplets;
+    triplets.reserve(9 * triangulation.triangleCount());
+    std::vector<double> rhs(numberOfUnknowns, 0.0);
+    for (size_t t = 0; t < triangulation.triangleCount(); t++) {
+	const int* v = &outTriangles[3 * t];
+	Geometry::Vector2D edge[3];	// Edge opposite to each vertex.
+	for (int i = 0; i < 3; i++) {
+	    edge[i] = reference.points[v[(i + 2) % 3]] - reference.points[v[(i + 1) % 3]];
+	}
+	double area = 0.5 * std::abs(edge[0][0] * edge[1][1] - edge[0][1] * edge[1][0]);
+	if (area == 0.0) {
+	    continue;
+	}
+	for (int i = 0; i < 3; i++) {
+	    if (reference.isBoundary[v[i]]) {
+		continue;
+	    }
+	    for (int j = 0; j < 3; j++) {
+		double k = edge[i].dot(edge[j]) / (4.0 * area);
+		if (reference.isBoundary[v[j]]) {
+		    rhs[unknown[v[i]]] -= k * reference.values[v[j]];
+		}
+		else {
+		    triplets.push_back({ unknown[v[i]], unknown[v[j]], k });
+		}
+	    }
+	}
+    }
+    SparseMatrix A = assemble(triplets, numberOfUnknowns);
+
+    std::vector<double> x(numberOfUnknowns, 0.0);
+    reference.iterations = solve(A, rhs, x);
+    for (size_t i = 0; i < n; i++) {
+	if (!reference.isBoundary[i]) {
+	    reference.values[i] = x[unknown[i]];
+	}
+    }
+
+    return reference;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "geometry.hh"
+
+namespace Benchmark {
+
+  /*
+   * Finite element (linear triangle) solution of the Laplace equation with Dirichlet boundary values,
+   * used as the ground truth for the harmonic surface approximated by ModifiedGordonWixomSurface.
+  */
+  struct HarmonicReference {
+    std::vector<Geometry::Point2D> points;	// Vertices of the refined Triangle mesh.
+    std::vector<double> values;			// Solution at the vertices.
+    std::vector<bool> isBoundary;
+    int iterations = 0;				// Conjugate gradient iterations used.
+  };
+
+  /*
+   * Meshes the domain bounded by curve (sampled at boundarySamples points) with triangles of area at most maxArea,
+   * prescribes height on the boundary vertices and solves for the interior vertices.
+  */
+  HarmonicReference solveHarmonicReference(const std::function<Geometry::Point2D(double)>& curve,
+					   const std::function<double(Geometry::Point2D)>& height,
+					   int boundarySamples, double maxArea);
+}
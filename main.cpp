@@ -1,86 +1,56 @@
-#include <fstream>
-#include <sstream>
-#include <vector>
 #include <cmath>
+#include <cstring>
 #include <functional>
-#define ANSI_DECLARATORS
-#define REAL double
-#define VOID void
+#include <iostream>
+#include <stdexcept>
 
+#include "boundaryreader.h"
+#include "geometrywriter.h"
 #include "modifiedgordonwixomsurface.h"
-extern "C" {
-#include "triangle/triangle.h"
-}
-
-void write_geometry(const Geometry::ModifiedGordonWixomSurface& surface, const char* filename) {
-	std::vector<Geometry::Point2D> discretizedCurve = surface.getDiscretizedCurve();
-
-	size_t n = discretizedCurve.size();	// # of points
-	std::cout << "Number of curve points: " << n << std::endl;
-	std::vector<double> points;
-	points.reserve(n * 2);
-	for (int i = 0; i < n; i++) {
-		points.push_back(discretizedCurve[i][0]);
-		points.push_back(discretizedCurve[i][1]);
-	}
-	double max_area = 0.0025 * 0.611416847148; // nice number
-
-  // Input segments : just a closed polygon
-  std::vector<int> segments; segments.reserve(n * 2);
-  for (size_t i = 0; i < n; ++i) {
-    segments.push_back(i);
-    segments.push_back(i + 1);
-  }
-  segments.back() = 0;
-
-  // Setup output data structure
-  struct triangulateio in, out;
-  in.pointlist = &points[0];
-  in.numberofpoints = n;
-  in.numberofpointattributes = 0;
-  in.pointmarkerlist = nullptr;
-  in.segmentlist = &segments[0];
-  in.numberofsegments = n;
-  in.segmentmarkerlist = nullptr;
-  in.numberofholes = 0;
-  in.numberofregions = 0;
-
-  // Setup output data structure
-  out.pointlist = nullptr;
-  out.pointattributelist = nullptr;
-  out.pointmarkerlist = nullptr;
-  out.trianglelist = nullptr;
-  out.triangleattributelist = nullptr;
-  out.segmentlist = nullptr;
-  out.segmentmarkerlist = nullptr;
-
-  // Call the library function
-  // Look up all the switches to see what they do!
-  std::ostringstream cmd;
-  cmd << "pqa" << std::fixed << max_area << "DBPzQ";
-  triangulate(const_cast<char *>(cmd.str().c_str()), &in, &out, (struct triangulateio *)nullptr);
-
-	// Write an OBJ file as the output
-	std::ofstream f(filename);
-	for (int i = 0; i < out.numberofpoints; ++i)
-		f << "v "
-		<< out.pointlist[2*i] << ' '
-		<< surface.eval(Geometry::Point2D(out.pointlist[2 * i], out.pointlist[2 * i + 1])) << ' '
-		<< out.pointlist[2 * i + 1]
-		<< std::endl;
-	for (int i = 0; i < out.numberoftriangles; ++i)
-		f << "f "
-			<< out.trianglelist[3*i] + 1 << ' '
-			<< out.trianglelist[3*i+1] + 1 << ' '
-			<< out.trianglelist[3*i+2] + 1 << std::endl;
-
-	trifree(out.pointlist);
-	trifree(out.trianglelist);
-	std::cout << "Writing " << filename << " is finished." << std::endl;
-}
 
 
 int main(int argc, char **argv) {
+	// Surfaces over the same boundary share its triangulation; with --triangulation-cache DIR also across runs.
+	// With --boundary FILE OUTPUT only the surface over the sampled boundary loops in FILE (see boundaryreader.h) is written.
+	std::string cacheDirectory;
+	const char* boundaryFile = nullptr;
+	const char* outputFile = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--triangulation-cache") == 0 && i + 1 < argc) {
+			cacheDirectory = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--boundary") == 0 && i + 2 < argc) {
+			boundaryFile = argv[++i];
+			outputFile = argv[++i];
+		}
+		else {
+			std::cout << "Usage: " << argv[0] << " [--triangulation-cache DIR] [--boundary FILE OUTPUT]" << std::endl;
+			return 1;
+		}
+	}
+	Geometry::TriangulationCache cache(cacheDirectory);
+	GeometryOptions options;
+	options.triangulationCache = &cache;
+
+	if (boundaryFile != nullptr) {
+		try {
+			Geometry::BoundaryLoops loops = Geometry::readBoundary(boundaryFile);
+			if (loops.empty()) {
+				std::cout << "Cannot read " << boundaryFile << std::endl;
+				return 1;
+			}
+			Geometry::ModifiedGordonWixomSurface surface(loops[0]);
+			for (size_t i = 1; i < loops.size(); i++) {
+				surface.addInnerLoop(loops[i]);
+			}
+			write_geometry(surface, outputFile, options);
+		}
+		catch (const std::invalid_argument& e) {
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
 
 	// Create surfaces:
 	Geometry::ModifiedGordonWixomSurface surface0(
@@ -91,7 +61,7 @@ int main(int argc, char **argv) {
 			[](Geometry::Point2D p) { return 0.5 * std::sin(p[0] * 2 * M_PI) + 0.5 * std::sin(p[0] * 2 * M_PI); }
 		)
 	);
-	write_geometry(surface0, "surface0.obj");
+	write_geometry(surface0, "surface0.obj", options);
 
 	Geometry::ModifiedGordonWixomSurface surface1(
 		std::function<Geometry::Point2D(double)>(
@@ -101,7 +71,7 @@ int main(int argc, char **argv) {
 			[](Geometry::Point2D p) { return 0.5 * std::sin(p[0] * 2 * M_PI) + 0.5 * std::sin(p[0] * 2 * M_PI); }
 		)
 	);
-	write_geometry(surface1, "surface1.obj");
+	write_geometry(surface1, "surface1.obj", options);
 
 	Geometry::ModifiedGordonWixomSurface surface2(
 		std::function<Geometry::Point2D(double)>(
@@ -111,7 +81,7 @@ int main(int argc, char **argv) {
 			[](Geometry::Point2D p) { return 0.5 * std::sin(p[0] * 2 * M_PI) + 0.5 * std::sin(p[0] * 2 * M_PI); }
 		)
 	);
-	write_geometry(surface2, "surface2.obj");
+	write_geometry(surface2, "surface2.obj", options);
 
 	Geometry::ModifiedGordonWixomSurface surface3(
 		std::function<Geometry::Point2D(double)>(
@@ -121,7 +91,7 @@ int main(int argc, char **argv) {
 			[](Geometry::Point2D p) { return 0.5 * std::sin(p[0] * 2 * M_PI) * 0.5 * std::sin(p[0] * 2 * M_PI); }
 		)
 	);
-	write_geometry(surface3, "surface3.obj");
+	write_geometry(surface3, "surface3.obj", options);
 
 	Geometry::ModifiedGordonWixomSurface surface4(
 		std::function<Geometry::Point2D(double)>(
@@ -131,7 +101,7 @@ int main(int argc, char **argv) {
 			[](Geometry::Point2D p) { return std::sin(std::sqrt(std::pow(p[0], 2) + std::pow(p[1], 2)) * M_PI) + (std::pow(p[0], 2) + std::pow(p[1], 2)) * 0.1; }
 		)
 	);
-	write_geometry(surface4, "surface4.obj");
+	write_geometry(surface4, "surface4.obj", options);
 
 	Geometry::ModifiedGordonWixomSurface surface5(
 		std::function<Geometry::Point2D(double)>(
@@ -144,7 +114,7 @@ int main(int argc, char **argv) {
 			}
 		)
 	);
-	write_geometry(surface5, "surface5.obj");
+	write_geometry(surface5, "surface5.obj", options);
 
 	Geometry::ModifiedGordonWixomSurface surface6(
 		std::function<Geometry::Point2D(double)>(
@@ -158,7 +128,7 @@ int main(int argc, char **argv) {
 			}
 		)
 	);
-	write_geometry(surface6, "surface6.obj");
+	write_geometry(surface6, "surface6.obj", options);
 
 	Geometry::ModifiedGordonWixomSurface surface7(
 		std::function<Geometry::Point2D(double)>(
@@ -173,7 +143,7 @@ int main(int argc, char **argv) {
 			}
 		)
 	);
-	write_geometry(surface7, "surface7.obj");
+	write_geometry(surface7, "surface7.obj", options);
 
 	return 0;
 }
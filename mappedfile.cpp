@@ -0,0 +1,41 @@
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Geometry::MappedFile::MappedFile(const std::string& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+	return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+	void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p != MAP_FAILED) {
+	    mapping = static_cast<const char*>(p);
+	    length = st.st_size;
+	    madvise(p, length, MADV_SEQUENTIAL);
+	}
+    }
+    close(fd);
+}
+
+Geometry::MappedFile::~MappedFile()
+{
+    if (mapping != nullptr) {
+	munmap(const_cast<char*>(mapping), length);
+    }
+}
+
+const char* Geometry::MappedFile::data() const
+{
+    return mapping;
+}
+
+size_t Geometry::MappedFile::size() const
+{
+    return length;
+}
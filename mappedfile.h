@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Geometry {
+
+  /*
+   * Read-only memory mapping of a whole file; data() is null if the file cannot be opened or is empty.
+  */
+  class MappedFile
+  {
+  public:
+    explicit MappedFile(const std::string& filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const;
+
+    size_t size() const;
+
+  private:
+    const char* mapping = nullptr;
+    size_t length = 0;
+  };
+}
@@ -0,0 +1,223 @@
+#include "meshreorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+    // Index of (x, y) along the Hilbert curve filling a 2^16 x 2^16 grid.
+    uint64_t hilbertIndex(uint32_t x, uint32_t y)
+    {
+	uint64_t d = 0;
+	for (uint32_t s = 1u << 15; s > 0; s /= 2) {
+	    uint32_t rx = (x & s) > 0;
+	    uint32_t ry = (y & s) > 0;
+	    d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+	    // Rotate the quadrant:
+	    if (ry == 0) {
+		if (rx == 1) {
+		    x = s - 1 - x;
+		    y = s - 1 - y;
+		}
+		std::swap(x, y);
+	    }
+	}
+	return d;
+    }
+
+    // Forsyth's vertex score: recently used vertices and vertices with few remaining triangles first.
+    double vertexScore(int cachePosition, int remainingTriangles, int cacheSize)
+    {
+	constexpr double cacheDecayPower = 1.5;
+	constexpr double lastTriangleScore = 0.75;
+	constexpr double valenceBoostScale = 2.0;
+	constexpr double valenceBoostPower = 0.5;
+	if (remainingTriangles == 0) {
+	    return -1.0;
+	}
+	double score = 0.0;
+	if (cachePosition >= 0) {
+	    if (cachePosition < 3) {
+		score = lastTriangleScore;	// The vertices of the last triangle are scored equally.
+	    }
+	    else {
+		score = std::pow(1.0 - (cachePosition - 3) / static_cast<double>(cacheSize - 3), cacheDecayPower);
+	    }
+	}
+	return score + valenceBoostScale * std::pow(remainingTriangles, -valenceBoostPower);
+    }
+}
+
+std::vector<int> Geometry::hilbertOrder(const PointVector& points, int u, int v)
+{
+    std::vector<int> order(points.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (points.empty()) {
+	return order;
+    }
+    double min[2] = { points[0][u], points[0][v] }, max[2] = { points[0][u], points[0][v] };
+    for (const Point3D& p : points) {
+	min[0] = std::min(min[0], p[u]);
+	min[1] = std::min(min[1], p[v]);
+	max[0] = std::max(max[0], p[u]);
+	max[1] = std::max(max[1], p[v]);
+    }
+    double extent = std::max({ max[0] - min[0], max[1] - min[1], std::numeric_limits<double>::min() });
+    double scale = 65535.0 / extent;
+    std::vector<uint64_t> keys(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+	keys[i] = hilbertIndex(static_cast<uint32_t>((points[i][u] - min[0]) * scale),
+			       static_cast<uint32_t>((points[i][v] - min[1]) * scale));
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+    return order;
+}
+
+void Geometry::reorderVertices(TriMesh& mesh, const std::vector<int>& order)
+{
+    std::vector<int> newIndex(order.size());
+    PointVector points(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+	newIndex[order[i]] = static_cast<int>(i);
+	points[i] = mesh[order[i]];
+    }
+    mesh.setPoints(points);
+    if (!mesh.normals().empty()) {
+	VectorVector normals(order.size());
+	for (size_t i = 0; i < order.size(); i++) {
+	    normals[i] = mesh.normals()[order[i]];
+	}
+	mesh.normals() = std::move(normals);
+    }
+    for (TriMesh::Triangle& t : mesh.triangles()) {
+	for (int& index : t) {
+	    index = newIndex[index];
+	}
+    }
+}
+
+void Geometry::optimizeVertexCache(TriMesh& mesh, int cacheSize)
+{
+    std::span<TriMesh::Triangle> triangles = mesh.triangles();
+    const size_t n = mesh.points().size();
+    const size_t m = triangles.size();
+    if (m == 0) {
+	return;
+    }
+
+    // Vertex -> triangle adjacency in compressed rows:
+    std::vector<int> remaining(n, 0);
+    for (const TriMesh::Triangle& t : triangles) {
+	for (int index : t) {
+	    remaining[index]++;
+	}
+    }
+    std::vector<size_t> adjacencyStart(n + 1, 0);
+    for (size_t i = 0; i < n; i++) {
+	adjacencyStart[i + 1] = adjacencyStart[i] + remaining[i];
+    }
+    std::vector<int> adjacency(adjacencyStart[n]);
+    std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t i = 0; i < m; i++) {
+	for (int index : triangles[i]) {
+	    adjacency[fill[index]++] = static_cast<int>(i);
+	}
+    }
+
+    std::vector<int> cachePosition(n, -1);
+    std::vector<double> score(n);
+    for (size_t i = 0; i < n; i++) {
+	score[i] = vertexScore(-1, remaining[i], cacheSize);
+    }
+    std::vector<double> triangleScore(m);
+    for (size_t i = 0; i < m; i++) {
+	triangleScore[i] = score[triangles[i][0]] + score[triangles[i][1]] + score[triangles[i][2]];
+    }
+    std::vector<bool> emitted(m, false);
+    std::vector<int> cache, nextCache;
+    std::vector<TriMesh::Triangle> result;
+    result.reserve(m);
+
+    size_t scan = 0;	// All triangles before scan are emitted.
+    int best = static_cast<int>(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    while (best >= 0) {
+	emitted[best] = true;
+	result.push_back(triangles[best]);
+
+	// Move the vertices of the triangle to the front of the LRU cache:
+	nextCache.assign(triangles[best].begin(), triangles[best].end());
+	for (int index : triangles[best]) {
+	    remaining[index]--;
+	}
+	for (int index : cache) {
+	    if (index != triangles[best][0] && index != triangles[best][1] && index != triangles[best][2]) {
+		nextCache.push_back(index);
+	    }
+	}
+	std::swap(cache, nextCache);
+	for (size_t i = cacheSize; i < cache.size(); i++) {
+	    cachePosition[cache[i]] = -1;	// Evicted
+	}
+	nextCache.assign(cache.begin() + std::min<size_t>(cache.size(), cacheSize), cache.end());
+	cache.resize(std::min<size_t>(cache.size(), cacheSize));
+
+	// Rescore the vertices whose cache position changed and their triangles, looking for the next best one:
+	for (size_t i = 0; i < cache.size(); i++) {
+	    cachePosition[cache[i]] = static_cast<int>(i);
+	}
+	for (const std::vector<int>* vertices : { &cache, &nextCache }) {
+	    for (int index : *vertices) {
+		double newScore = vertexScore(cachePosition[index], remaining[index], cacheSize);
+		double delta = newScore - score[index];
+		score[index] = newScore;
+		for (size_t k = adjacencyStart[index]; k < adjacencyStart[index + 1]; k++) {
+		    triangleScore[adjacency[k]] += delta;
+		}
+	    }
+	}
+	best = -1;
+	double bestScore = -1.0;
+	for (int index : cache) {
+	    for (size_t k = adjacencyStart[index]; k < adjacencyStart[index + 1]; k++) {
+		int t = adjacency[k];
+		if (!emitted[t] && triangleScore[t] > bestScore) {
+		    bestScore = triangleScore[t];
+		    best = t;
+		}
+	    }
+	}
+
+	// Nothing adjacent to the cache: continue with any triangle left.
+	if (best < 0) {
+	    while (scan < m && emitted[scan]) {
+		scan++;
+	    }
+	    best = (scan < m) ? static_cast<int>(scan) : -1;
+	}
+    }
+    std::copy(result.begin(), result.end(), triangles.begin());
+}
+
+double Geometry::averageCacheMissRatio(const TriMesh& mesh, int cacheSize)
+{
+    std::span<const TriMesh::Triangle> triangles = mesh.triangles();
+    if (triangles.empty()) {
+	return 0.0;
+    }
+    // FIFO cache: a vertex is in the cache if it was loaded within the last cacheSize misses.
+    std::vector<size_t> loadedAt(mesh.points().size(), 0);
+    size_t misses = 0;
+    for (const TriMesh::Triangle& t : triangles) {
+	for (int index : t) {
+	    if (loadedAt[index] == 0 || misses - loadedAt[index] >= static_cast<size_t>(cacheSize)) {
+		misses++;
+		loadedAt[index] = misses;
+	    }
+	}
+    }
+    return static_cast<double>(misses) / triangles.size();
+}
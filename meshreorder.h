@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.hh"
+
+namespace Geometry {
+
+  /*
+   * Vertex order along a Hilbert curve over the coordinates u and v of the points (e.g. 0 and 2 for (x, height, y)),
+   * so that vertices close in the plane are close in memory.
+  */
+  std::vector<int> hilbertOrder(const PointVector& points, int u, int v);
+
+  /*
+   * Moves vertex order[i] to position i (points and normals) and remaps the triangle indices.
+  */
+  void reorderVertices(TriMesh& mesh, const std::vector<int>& order);
+
+  /*
+   * Reorders the triangles for a post-transform vertex cache (Forsyth's linear-speed greedy algorithm).
+  */
+  void optimizeVertexCache(TriMesh& mesh, int cacheSize = 32);
+
+  /*
+   * Average cache miss ratio (transformed vertices per triangle) of a FIFO vertex cache; 0.5 is optimal, 3 is worst.
+  */
+  double averageCacheMissRatio(const TriMesh& mesh, int cacheSize = 32);
+}
@@ -0,0 +1,202 @@
+#include "meshwriter.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+Geometry::BufferedWriter::BufferedWriter(const char* filename, size_t bufferSize)
+    : file(std::fopen(filename, "wb")), buffer(bufferSize < 64 ? 64 : bufferSize)
+{
+    if (file == nullptr) {
+	failed = true;
+    }
+    else {
+	std::setvbuf(file, nullptr, _IONBF, 0);	// We do the buffering.
+    }
+}
+
+Geometry::BufferedWriter::~BufferedWriter()
+{
+    flush();
+    if (file != nullptr) {
+	std::fclose(file);
+    }
+}
+
+bool Geometry::BufferedWriter::good() const
+{
+    return !failed;
+}
+
+void Geometry::BufferedWriter::write(const void* data, size_t size)
+{
+    if (size >= buffer.size()) {
+	flush();
+	if (file != nullptr && std::fwrite(data, 1, size, file) != size) {
+	    failed = true;
+	}
+	return;
+    }
+    std::memcpy(reserve(size), data, size);
+    used += size;
+}
+
+void Geometry::BufferedWriter::put(char c)
+{
+    *reserve(1) = c;
+    used++;
+}
+
+void Geometry::BufferedWriter::number(double x, int precision)
+{
+    constexpr size_t maxLength = 32;	// sign, 17 digits, point, exponent
+    constexpr int maxPrecision = 17;	// Enough to round-trip any double.
+    char* begin = reserve(maxLength);
+    std::to_chars_result result = std::to_chars(begin, begin + maxLength, x, std::chars_format::general,
+						precision < maxPrecision ? precision : maxPrecision);
+    used += result.ptr - begin;
+}
+
+void Geometry::BufferedWriter::number(long long i)
+{
+    constexpr size_t maxLength = 24;
+    char* begin = reserve(maxLength);
+    std::to_chars_result result = std::to_chars(begin, begin + maxLength, i);
+    used += result.ptr - begin;
+}
+
+void Geometry::BufferedWriter::flush()
+{
+    if (used > 0 && file != nullptr && std::fwrite(buffer.data(), 1, used, file) != used) {
+	failed = true;
+    }
+    used = 0;
+}
+
+char* Geometry::BufferedWriter::reserve(size_t size)
+{
+    if (used + size > buffer.size()) {
+	flush();
+    }
+    return buffer.data() + used;
+}
+
+Geometry::OBJWriter::OBJWriter(const char* filename, int _precision)
+    : writer(filename), precision(_precision)
+{
+}
+
+bool Geometry::OBJWriter::good() const
+{
+    return writer.good();
+}
+
+void Geometry::OBJWriter::vertex(double x, double y, double z)
+{
+    triple("v ", x, y, z);
+}
+
+void Geometry::OBJWriter::normal(double x, double y, double z)
+{
+    triple("vn ", x, y, z);
+}
+
+void Geometry::OBJWriter::face(long long a, long long b, long long c)
+{
+    writer.write("f ", 2);
+    writer.number(a + 1);
+    writer.put(' ');
+    writer.number(b + 1);
+    writer.put(' ');
+    writer.number(c + 1);
+    writer.put('\n');
+}
+
+void Geometry::OBJWriter::faceWithNormals(long long a, long long b, long long c)
+{
+    const long long indices[3] = { a, b, c };
+    writer.write("f ", 2);
+    for (int i = 0; i < 3; i++) {
+	writer.number(indices[i] + 1);
+	writer.write("//", 2);
+	writer.number(indices[i] + 1);
+	writer.put(i == 2 ? '\n' : ' ');
+    }
+}
+
+void Geometry::OBJWriter::flush()
+{
+    writer.flush();
+}
+
+void Geometry::OBJWriter::triple(const char* keyword, double x, double y, double z)
+{
+    writer.write(keyword, std::strlen(keyword));
+    writer.number(x, precision);
+    writer.put(' ');
+    writer.number(y, precision);
+    writer.put(' ');
+    writer.number(z, precision);
+    writer.put('\n');
+}
+
+Geometry::PLYWriter::PLYWriter(const char* filename, size_t vertexCount, size_t faceCount, bool normals)
+    : writer(filename)
+{
+    std::string header = "ply\nformat binary_little_endian 1.0\n"
+	"element vertex " + std::to_string(vertexCount) + "\n"
+	"property float x\nproperty float y\nproperty float z\n";
+    if (normals) {
+	header += "property float nx\nproperty float ny\nproperty float nz\n";
+    }
+    header += "element face " + std::to_string(faceCount) + "\n"
+	"property list uchar int vertex_indices\nend_header\n";
+    writer.write(header.data(), header.size());
+}
+
+bool Geometry::PLYWriter::good() const
+{
+    return writer.good();
+}
+
+void Geometry::PLYWriter::vertex(double x, double y, double z)
+{
+    const float record[3] = { littleEndian(static_cast<float>(x)), littleEndian(static_cast<float>(y)),
+			      littleEndian(static_cast<float>(z)) };
+    writer.write(record, sizeof(record));
+}
+
+void Geometry::PLYWriter::vertex(double x, double y, double z, double nx, double ny, double nz)
+{
+    const float record[6] = { littleEndian(static_cast<float>(x)), littleEndian(static_cast<float>(y)),
+			      littleEndian(static_cast<float>(z)), littleEndian(static_cast<float>(nx)),
+			      littleEndian(static_cast<float>(ny)), littleEndian(static_cast<float>(nz)) };
+    writer.write(record, sizeof(record));
+}
+
+void Geometry::PLYWriter::faces(const int* indices, size_t count)
+{
+    // Records are 13 bytes (count + 3 indices), so they are assembled in a small staging block.
+    constexpr size_t recordSize = 1 + 3 * sizeof(int32_t);
+    constexpr size_t blockFaces = 4096;
+    unsigned char block[blockFaces * recordSize];
+    for (size_t first = 0; first < count; first += blockFaces) {
+	size_t n = (count - first < blockFaces) ? count - first : blockFaces;
+	unsigned char* record = block;
+	for (size_t i = 0; i < n; i++, record += recordSize) {
+	    record[0] = 3;
+	    for (int j = 0; j < 3; j++) {
+		int32_t index = littleEndian(static_cast<int32_t>(indices[3 * (first + i) + j]));
+		std::memcpy(record + 1 + j * sizeof(int32_t), &index, sizeof(int32_t));
+	    }
+	}
+	writer.write(block, n * recordSize);
+    }
+}
+
+void Geometry::PLYWriter::flush()
+{
+    writer.flush();
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace Geometry {
+
+  /*
+   * x in little-endian byte order, as binary PLY and STL files store it, on any host.
+  */
+  template <typename T>
+  T littleEndian(T x)
+  {
+    if constexpr (std::endian::native == std::endian::little) {
+	return x;
+    }
+    else {
+	unsigned char bytes[sizeof(T)];
+	std::memcpy(bytes, &x, sizeof(T));
+	for (size_t i = 0; i < sizeof(T) / 2; i++) {
+	    std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+	}
+	std::memcpy(&x, bytes, sizeof(T));
+	return x;
+    }
+  }
+
+  /*
+   * Output file with a large reusable buffer that is written in big blocks, without per-line flushes.
+   * Numbers are formatted with std::to_chars, independently of the global locale.
+  */
+  class BufferedWriter
+  {
+  public:
+    explicit BufferedWriter(const char* filename, size_t bufferSize = 1 << 20);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    /*
+     * False if the file could not be opened or a write failed.
+    */
+    bool good() const;
+
+    void write(const void* data, size_t size);
+
+    void put(char c);
+
+    /*
+     * Writes x like std::ostream with the given precision (%g formatting).
+    */
+    void number(double x, int precision);
+
+    void number(long long i);
+
+    void flush();
+
+  private:
+    // Makes room for at least size bytes in the buffer.
+    char* reserve(size_t size);
+
+    std::FILE* file;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool failed = false;
+  };
+
+  /*
+   * Wavefront OBJ writer on top of BufferedWriter. Indices are zero-based and written one-based.
+  */
+  class OBJWriter
+  {
+  public:
+    explicit OBJWriter(const char* filename, int precision = 6);
+
+    bool good() const;
+
+    void vertex(double x, double y, double z);
+
+    void normal(double x, double y, double z);
+
+    void face(long long a, long long b, long long c);
+
+    /*
+     * Face whose vertices use the normals of the same index (f a//a b//b c//c).
+    */
+    void faceWithNormals(long long a, long long b, long long c);
+
+    void flush();
+
+  private:
+    void triple(const char* keyword, double x, double y, double z);
+
+    BufferedWriter writer;
+    int precision;
+  };
+
+  /*
+   * Binary little-endian PLY writer: float32 positions (and normals), int32 triangle indices.
+   * The element counts are part of the header, so they have to be known in advance.
+  */
+  class PLYWriter
+  {
+  public:
+    PLYWriter(const char* filename, size_t vertexCount, size_t faceCount, bool normals);
+
+    bool good() const;
+
+    void vertex(double x, double y, double z);
+
+    void vertex(double x, double y, double z, double nx, double ny, double nz);
+
+    /*
+     * Writes count triangles from a zero-based index array of 3 * count elements, e.g. triangulateio::trianglelist.
+    */
+    void faces(const int* indices, size_t count);
+
+    void flush();
+
+  private:
+    BufferedWriter writer;
+  };
+}
@@ -1,20 +1,73 @@
 #include "modifiedgordonwixomsurface.h"
 #include <math.h>
 
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
 Geometry::ModifiedGordonWixomSurface::ModifiedGordonWixomSurface(const std::function<Point2D(double)>& _curve,
                                                                  const std::function<double(Point2D)>& _height)
-    : curve(_curve), height(_height)
+    : loops(1)
+{
+    loops[0].curve = _curve;
+    loops[0].height = _height;
+    discretizeCurve();
+}
+
+Geometry::ModifiedGordonWixomSurface::ModifiedGordonWixomSurface(const BSCurve& _curve)
+    : loops(1, splineLoop(_curve))
+{
+    discretizeCurve();
+}
+
+Geometry::ModifiedGordonWixomSurface::ModifiedGordonWixomSurface(const PolarCurve& _curve, const std::function<double(Point2D)>& _height)
+    : loops(1, polarLoop(_curve, _height))
+{
+    discretizeCurve();
+}
+
+Geometry::ModifiedGordonWixomSurface::ModifiedGordonWixomSurface(const PointVector& samples, HeightInterpolation interpolation)
+    : ModifiedGordonWixomSurface(std::span<const Point3D>(samples), interpolation)
+{
+}
+
+Geometry::ModifiedGordonWixomSurface::ModifiedGordonWixomSurface(std::span<const Point3D> samples, HeightInterpolation interpolation)
+    : loops(1, sampledLoop(samples, interpolation))
 {
     discretizeCurve();
 }
 
 double Geometry::ModifiedGordonWixomSurface::eval(const Point2D &x) const
 {
-    constexpr int n = 128;
-    constexpr double delta_theta = M_PI / n;
+    return integrate(x, nullptr);
+}
+
+std::pair<double, Geometry::Vector2D> Geometry::ModifiedGordonWixomSurface::evalWithGradient(const Point2D &x) const
+{
+    Vector2D gradient(0.0, 0.0);
+    double u = integrate(x, &gradient);
+    return std::make_pair(u, gradient);
+}
+
+/*
+ * Every intersection point p = x + s * direction lies on the line of its segment (point p0, unit tangent T, normal N),
+ * so N * (x + s * direction - p0) = 0 gives grad s = -N / (N * direction) and the distance |s| changes accordingly.
+ * The derivative of the height along T is taken by a central difference of the height function on the segment.
+ * Directions with a tangential hit (N * direction = 0) have no such derivative; the gradient is then that of
+ * the quotient over the other directions.
+*/
+double Geometry::ModifiedGordonWixomSurface::integrate(const Point2D &x, Vector2D *gradient) const
+{
+    const int n = directionCount;
+    const double delta_theta = M_PI / n;
     constexpr double offset = 0.1;
+    constexpr double tangential = 1e-8;	// Limit of |N * direction| for the gradient
     double integral_den = 0.0;
     double integral_div = 0.0;
+    double gradient_den = 0.0;		// The integrals over the directions used for the gradient
+    double gradient_div = 0.0;
+    Vector2D grad_den(0.0, 0.0);
+    Vector2D grad_div(0.0, 0.0);
     for (int i = 0; i < n; i++) {
 	Vector2D direction(std::cos(i * delta_theta + offset), std::sin(i * delta_theta + offset));
 	if (direction[0] == 0.0 || direction[1] == 0.0) {
@@ -22,155 +75,581 @@ double Geometry::ModifiedGordonWixomSurface::eval(const Point2D &x) const
 	    std::cout << "Recalculating direction." << std::endl;
 	}
 
-	auto intersections = findLineCurveIntersections(x, direction);
-	
+	auto intersections = intersectLine(x, direction);
 
 	// Calculate weights:
 	double a = 0.0;
 	double b = 0.0;
 	double c = 1.0;
-	double d = 0.0;
-	for (int j = 0; j < intersections.first.size(); j++) {
-	    if (intersections.first[j].second) {	// is hitting concave corner?
-//		continue;
-	    }
-	    double distance = (intersections.first[j].first - x).length();
-	    if (distance == 0) {
-		    return height(x);
+	Vector2D grad_a(0.0, 0.0);
+	Vector2D grad_b(0.0, 0.0);
+	Vector2D grad_c(0.0, 0.0);
+	bool differentiable = gradient != nullptr;
+	for (int side = 0; side < 2; side++) {
+	    const std::vector<Intersection>& hits = (side == 0)? intersections.first : intersections.second;
+	    double d = 0.0;
+	    Vector2D grad_d(0.0, 0.0);
+	    for (size_t j = 0; j < hits.size(); j++) {
+		if (hits[j].isConcaveCorner) {	// is hitting concave corner?
+//		    continue;
+		}
+		double distance = hits[j].distance;
+		if (distance == 0) {
+		    if (gradient != nullptr) {
+			// On the boundary only the derivative along the curve is known.
+			Vector2D tangent = tangentAt(hits[j]);
+			*gradient = tangent * heightSlopeAt(hits[j], tangent);
+		    }
+		    return heightAt(hits[j]);
+		}
+		double sign = (j % 2 == 0) ? 1.0 : -1.0;
+		double h = heightAt(hits[j]);
+		a += sign * h / distance;
+		b += sign / distance;
+		d += sign / distance;
+		if (differentiable) {
+		    Vector2D tangent = tangentAt(hits[j]);
+		    Vector2D normal(-tangent[1], tangent[0]);
+		    double normalDotDirection = normal.dot(direction);
+		    if (std::abs(normalDotDirection) < tangential) {
+			differentiable = false;
+			continue;
+		    }
+		    // The first side lies behind x (s < 0), the second one ahead of it (s > 0):
+		    Vector2D grad_distance = normal * (((side == 0)? 1.0 : -1.0) / normalDotDirection);
+		    Vector2D grad_h = (tangent - normal * (tangent.dot(direction) / normalDotDirection)) * heightSlopeAt(hits[j], tangent);
+		    Vector2D grad_inverse_distance = grad_distance * (-1.0 / (distance * distance));
+		    grad_a += (grad_h / distance + grad_inverse_distance * h) * sign;
+		    grad_b += grad_inverse_distance * sign;
+		    grad_d += grad_inverse_distance * sign;
+		}
 	    }
-	    a += ((j % 2 == 0) ? 1.0 : -1.0) * height(intersections.first[j].first) / distance;
-	    b += ((j % 2 == 0) ? 1.0 : -1.0) / distance;
-	    d += ((j % 2 == 0) ? 1.0 : -1.0) / distance;
-	}
-	c *= d;
-	d = 0.0;
-	for (int j = 0; j < intersections.second.size(); j++) {
-	    if (intersections.second[j].second) {	// is hitting concave corner?
-//		continue;
+	    if (differentiable) {
+		grad_c = grad_c * d + grad_d * c;
 	    }
-	    double distance = (intersections.second[j].first - x).length();
-	    a += ((j % 2 == 0) ? 1.0 : -1.0) * height(intersections.second[j].first) / distance;
-	    if (distance == 0) {
-		    return height(x);
-	    }
-	    b += ((j % 2 == 0) ? 1.0 : -1.0) / distance;
-	    d += ((j % 2 == 0) ? 1.0 : -1.0) / distance;
+	    c *= d;
 	}
-	c *= d;
-	integral_den += a / b * c;
+	double f = a / b;
+	integral_den += f * c;
 	integral_div += c;
+	if (differentiable) {
+	    Vector2D grad_f = (grad_a - grad_b * f) / b;
+	    grad_den += grad_f * c + grad_c * f;
+	    grad_div += grad_c;
+	    gradient_den += f * c;
+	    gradient_div += c;
+	}
     }
     double u = integral_den / integral_div;
     if (u != u) {
 	std::cout << "u was NaN!" << std::endl;
 	std::cout << "u = " << integral_den << " / " << integral_div << std::endl; 
-	return height(x);
+	if (gradient != nullptr) {
+	    *gradient = Vector2D(0.0, 0.0);
+	}
+	return fallbackHeight(x);
     }
     else {
+	if (gradient != nullptr) {
+	    *gradient = (gradient_div != 0.0) ? (grad_den - grad_div * (gradient_den / gradient_div)) / gradient_div
+					      : Vector2D(0.0, 0.0);
+	}
 	return u;
     }
 }
 
 void Geometry::ModifiedGordonWixomSurface::setCurve(const std::function<Point2D(double)> &_curve)
 {
-    curve = _curve;
+    loops[0].curve = _curve;
+    loops[0].spline.reset();
+    loops[0].spans.clear();
+    loops[0].polar.reset();
+    loops[0].interpolation.reset();
+    loops[0].pointSlopes.clear();
     discretizeCurve();
 }
 
 void Geometry::ModifiedGordonWixomSurface::setHeight(const std::function<double(Point2D)>&_height)
 {
-    height = _height;
+    loops[0].height = _height;
+}
+
+void Geometry::ModifiedGordonWixomSurface::addInnerLoop(const std::function<Point2D(double)>& _curve,
+							const std::function<double(Point2D)>& _height)
+{
+    loops.push_back(Loop());
+    loops.back().curve = _curve;
+    loops.back().height = _height;
+    discretizeLoop(loops.back());
+    buildSegments();
+}
+
+void Geometry::ModifiedGordonWixomSurface::addInnerLoop(const BSCurve& _curve)
+{
+    loops.push_back(splineLoop(_curve));
+    discretizeLoop(loops.back());
+    buildSegments();
+}
+
+void Geometry::ModifiedGordonWixomSurface::addInnerLoop(const PolarCurve& _curve, const std::function<double(Point2D)>& _height)
+{
+    loops.push_back(polarLoop(_curve, _height));
+    discretizeLoop(loops.back());
+    buildSegments();
+}
+
+void Geometry::ModifiedGordonWixomSurface::addInnerLoop(const PointVector& samples, HeightInterpolation interpolation)
+{
+    addInnerLoop(std::span<const Point3D>(samples), interpolation);
+}
+
+void Geometry::ModifiedGordonWixomSurface::addInnerLoop(std::span<const Point3D> samples, HeightInterpolation interpolation)
+{
+    loops.push_back(sampledLoop(samples, interpolation));
+    buildSegments();
+}
+
+size_t Geometry::ModifiedGordonWixomSurface::getLoopCount() const
+{
+    return loops.size();
+}
+
+void Geometry::ModifiedGordonWixomSurface::setDirectionCount(int n)
+{
+    if (n < 1) {
+	throw std::invalid_argument("ModifiedGordonWixomSurface: the direction count has to be positive");
+    }
+    directionCount = n;
+}
+
+int Geometry::ModifiedGordonWixomSurface::getDirectionCount() const
+{
+    return directionCount;
+}
+
+void Geometry::ModifiedGordonWixomSurface::setCurveResolution(int n)
+{
+    if (n < 3) {
+	throw std::invalid_argument("ModifiedGordonWixomSurface: the curve resolution has to be at least 3");
+    }
+    curveResolution = n;
+    discretizeCurve();
+}
+
+int Geometry::ModifiedGordonWixomSurface::getCurveResolution() const
+{
+    return curveResolution;
 }
 
 void Geometry::ModifiedGordonWixomSurface::discretizeCurve()
 {
-    discretizedCurve.clear();
-    constexpr int n = 256;
-    for (int i = 0; i < n; i++) {
-        Point2D p = curve(i / (double)n);
-        discretizedCurve.push_back(p);
-
-        // Update min and max:
-        if (0 == i) {
-            boundingRectangleMin = p;
-            boundingRectangleMax = p;
-        }
-        else {
-            if (boundingRectangleMin[0] > p[0]) {
-                boundingRectangleMin[0] = p[0];
-            }
-            if (boundingRectangleMin[1] > p[1]) {
-                boundingRectangleMin[1] = p[1];
-            }
-            if (boundingRectangleMax[0] < p[0]) {
-                boundingRectangleMax[0] = p[0];
-            }
-            if (boundingRectangleMax[1] < p[1]) {
-                boundingRectangleMax[1] = p[1];
-            }
-        }
-    }
-
-    // Determine concave corners:
-    isConcaveCorner.clear();
-    isConcaveCorner.reserve(n);
+    for (Loop& loop : loops) {
+	discretizeLoop(loop);
+    }
+    buildSegments();
+}
+
+void Geometry::ModifiedGordonWixomSurface::discretizeLoop(Loop& loop) const
+{
+    if (loop.interpolation) {	// The samples are the discretization.
+	return;
+    }
+    loop.points.clear();
+    loop.pointHeights.clear();
+    const int n = curveResolution;
     for (int i = 0; i < n; i++) {
-	Point2D prev = discretizedCurve[(i > 0)? i - 1 : n - 1];
-	Point2D current = discretizedCurve[i];
-	Point2D next = discretizedCurve[(i < n - 1)? i + 1 : 0];
-	Vector2D tangent = (next - prev).normalize();
-	auto intersections = findLineCurveIntersections(current, tangent);
-	isConcaveCorner.push_back(intersections.first.size() % 2 == 1);	// tangent ray from concave corner will cross the polygon odd times.
-	
-    }
-}
-
- std::pair<std::vector<std::pair<Geometry::Point2D, bool>>, std::vector<std::pair<Geometry::Point2D, bool>>>
- Geometry::ModifiedGordonWixomSurface::findLineCurveIntersections(
-    const Point2D& x, const Vector2D& direction) const
-{
-    std::pair<std::vector<std::pair<Geometry::Point2D, bool>>, std::vector<std::pair<Geometry::Point2D, bool>>> intersection_points;  // The first of the pair is on one side of the line and the second of the pair is on the other side of the line respectively to the x point.
-    for (int i = 0; i < discretizedCurve.size(); i++){
-        Point2D p0 = discretizedCurve[i];
-        Point2D p1 = (i == discretizedCurve.size() - 1)? discretizedCurve[0] : discretizedCurve[i + 1];
-        Point2D sectionDiff = p1 - p0;
-        double sectionLength = sectionDiff.length();
-        if (sectionLength < std::numeric_limits<double>::min()) {
-            continue;
-        }
-        Vector2D sectionDir = sectionDiff / sectionLength;
-        double t = (p0[1] - x[1] - direction[1] * (p0[0] - x[0]) / direction[0])
-                   / (direction[1] * sectionDir[0] / direction[0] - sectionDir[1]);
-        if (t == t && t >= 0 && t < sectionLength) {
-            double tau = (p0[0] + t * sectionDir[0] - x[0]) / direction[0];
-	    if (tau != tau) {
-		std::cout << "Tau = NaN!" << std::endl;
+	if (loop.spline) {
+	    const BSBasis& basis = loop.spline->basis();
+	    Point3D p = loop.spline->eval(basis.low() + (basis.high() - basis.low()) * i / n);
+	    loop.points.push_back(Point2D(p[0], p[1]));
+	    loop.pointHeights.push_back(p[2]);
+	}
+	else {
+	    loop.points.push_back(loop.curve(i / (double)n));
+	}
+    }
+}
+
+Geometry::ModifiedGordonWixomSurface::Loop Geometry::ModifiedGordonWixomSurface::splineLoop(const BSCurve& curve)
+{
+    Loop loop;
+    loop.spline = curve;
+    loop.spans = curve.bezierSegments();
+    loop.curve = [curve](double t) {
+	const BSBasis& basis = curve.basis();
+	Point3D p = curve.eval(basis.low() + (basis.high() - basis.low()) * t);
+	return Point2D(p[0], p[1]);
+    };
+    return loop;
+}
+
+Geometry::ModifiedGordonWixomSurface::Loop Geometry::ModifiedGordonWixomSurface::polarLoop(const PolarCurve& curve,
+											 const std::function<double(Point2D)>& height)
+{
+    Loop loop;
+    loop.polar = curve;
+    loop.curve = [curve](double t) { return curve.eval(t * 2 * M_PI); };
+    loop.height = height;
+    return loop;
+}
+
+Geometry::ModifiedGordonWixomSurface::Loop Geometry::ModifiedGordonWixomSurface::sampledLoop(std::span<const Point3D> samples,
+											   HeightInterpolation interpolation)
+{
+    const size_t n = samples.size();
+    if (n < 3) {
+	throw std::invalid_argument("ModifiedGordonWixomSurface: a sampled loop needs at least 3 points");
+    }
+    Loop loop;
+    loop.interpolation = interpolation;
+    loop.points.reserve(n);
+    loop.pointHeights.reserve(n);
+    for (const Point3D& p : samples) {
+	loop.points.push_back(Point2D(p[0], p[1]));
+	loop.pointHeights.push_back(p[2]);
+    }
+    if (interpolation == HeightInterpolation::Cubic) {
+	// Central differences over the arc length, as the samples are not necessarily equidistant:
+	loop.pointSlopes.resize(n);
+	for (size_t i = 0; i < n; i++) {
+	    size_t prev = (i > 0)? i - 1 : n - 1;
+	    size_t next = (i < n - 1)? i + 1 : 0;
+	    double length = (loop.points[i] - loop.points[prev]).length() + (loop.points[next] - loop.points[i]).length();
+	    loop.pointSlopes[i] = (length > 0.0)? (loop.pointHeights[next] - loop.pointHeights[prev]) / length : 0.0;
+	}
+    }
+    return loop;
+}
+
+void Geometry::ModifiedGordonWixomSurface::buildSegments()
+{
+    segments.clear();
+    chunks.clear();
+    for (size_t l = 0; l < loops.size(); l++) {
+	const std::vector<Point2D>& points = loops[l].points;
+	const size_t n = points.size();
+	for (size_t i = 0; i < n; i++) {
+	    Point2D p = points[i];
+
+	    // Update min and max:
+	    if (l == 0 && i == 0) {
+		boundingRectangleMin = p;
+		boundingRectangleMax = p;
+	    }
+	    else {
+		if (boundingRectangleMin[0] > p[0]) {
+		    boundingRectangleMin[0] = p[0];
+		}
+		if (boundingRectangleMin[1] > p[1]) {
+		    boundingRectangleMin[1] = p[1];
+		}
+		if (boundingRectangleMax[0] < p[0]) {
+		    boundingRectangleMax[0] = p[0];
+		}
+		if (boundingRectangleMax[1] < p[1]) {
+		    boundingRectangleMax[1] = p[1];
+		}
+	    }
+
+	    // Degenerate segments are never intersected, and splines and polar curves are intersected directly:
+	    if (loops[l].spline || loops[l].polar) {
+		continue;
+	    }
+	    Point2D sectionDiff = points[(i == n - 1)? 0 : i + 1] - p;
+	    double sectionLength = sectionDiff.length();
+	    if (sectionLength < std::numeric_limits<double>::min()) {
+		continue;
+	    }
+	    Segment segment;
+	    segment.start = p;
+	    segment.direction = sectionDiff / sectionLength;
+	    segment.length = sectionLength;
+	    segment.loop = l;
+	    segment.index = i;
+	    segments.push_back(segment);
+	}
+
+	// Chunks of consecutive segments of this loop:
+	const size_t first = chunks.empty() ? 0 : chunks.back().end;
+	for (size_t begin = first; begin < segments.size(); begin += chunkSize) {
+	    SegmentChunk chunk;
+	    chunk.begin = begin;
+	    chunk.end = std::min(begin + chunkSize, segments.size());
+	    Point2D min = segments[begin].start, max = min;
+	    for (size_t k = begin; k < chunk.end; k++) {
+		const Segment& segment = segments[k];
+		Point2D end = points[(segment.index == n - 1)? 0 : segment.index + 1];
+		for (int j = 0; j < 2; j++) {
+		    min[j] = std::min({ min[j], segment.start[j], end[j] });
+		    max[j] = std::max({ max[j], segment.start[j], end[j] });
+		}
+	    }
+	    chunk.center = (min + max) / 2.0;
+	    chunk.halfSize = (max - min) / 2.0;
+	    chunks.push_back(chunk);
+	}
+    }
+
+    // Determine concave corners (against all loops, so the flags have to exist first):
+    for (Loop& loop : loops) {
+	loop.isConcaveCorner.assign(loop.points.size(), false);
+    }
+    for (Loop& loop : loops) {
+	if (loop.spline || loop.polar) {	// Smooth curves have no corners.
+	    continue;
+	}
+	const size_t n = loop.points.size();
+	std::vector<bool> isConcaveCorner(n);
+	for (size_t i = 0; i < n; i++) {
+	    Point2D prev = loop.points[(i > 0)? i - 1 : n - 1];
+	    Point2D current = loop.points[i];
+	    Point2D next = loop.points[(i < n - 1)? i + 1 : 0];
+	    Vector2D tangent = (next - prev).normalize();
+	    auto intersections = intersectLine(current, tangent);
+	    isConcaveCorner[i] = intersections.first.size() % 2 == 1;	// tangent ray from concave corner will cross the polygon odd times.
+	}
+	loop.isConcaveCorner = std::move(isConcaveCorner);
+    }
+}
+
+std::pair<std::vector<std::pair<Geometry::Point2D, bool>>, std::vector<std::pair<Geometry::Point2D, bool>>>
+Geometry::ModifiedGordonWixomSurface::findLineCurveIntersections(const Point2D& x, const Vector2D& direction) const
+{
+    auto intersections = intersectLine(x, direction);
+    std::pair<std::vector<std::pair<Geometry::Point2D, bool>>, std::vector<std::pair<Geometry::Point2D, bool>>> intersection_points;
+    for (const Intersection& hit : intersections.first) {
+	intersection_points.first.push_back(std::make_pair(hit.point, hit.isConcaveCorner));
+    }
+    for (const Intersection& hit : intersections.second) {
+	intersection_points.second.push_back(std::make_pair(hit.point, hit.isConcaveCorner));
+    }
+    return intersection_points;
+}
+
+std::pair<std::vector<Geometry::ModifiedGordonWixomSurface::Intersection>, std::vector<Geometry::ModifiedGordonWixomSurface::Intersection>>
+Geometry::ModifiedGordonWixomSurface::intersectLine(const Point2D& x, const Vector2D& direction) const
+{
+    std::pair<std::vector<Intersection>, std::vector<Intersection>> intersection_points;  // The first of the pair is on one side of the line and the second of the pair is on the other side of the line respectively to the x point.
+    // Lines farther from a chunk's box than the rounding of the segment test could reach skip all its segments:
+    const double margin = 1.0e-9 * (boundingRectangleMax - boundingRectangleMin).length() * (std::abs(direction[0]) + std::abs(direction[1]));
+    for (const SegmentChunk& chunk : chunks) {
+	Vector2D offset = chunk.center - x;
+	double lineDistance = std::abs(direction[0] * offset[1] - direction[1] * offset[0]);
+	double reach = std::abs(direction[0]) * chunk.halfSize[1] + std::abs(direction[1]) * chunk.halfSize[0];
+	if (lineDistance > reach + margin) {
+	    continue;
+	}
+	for (size_t k = chunk.begin; k < chunk.end; k++) {
+	    const Segment& segment = segments[k];
+	    const Loop& loop = loops[segment.loop];
+	    size_t i = segment.index;
+	    size_t next = (i == loop.points.size() - 1)? 0 : i + 1;
+	    const Point2D& p0 = segment.start;
+	    const Vector2D& sectionDir = segment.direction;
+	    double sectionLength = segment.length;
+	    double t = (p0[1] - x[1] - direction[1] * (p0[0] - x[0]) / direction[0])
+		       / (direction[1] * sectionDir[0] / direction[0] - sectionDir[1]);
+	    if (t == t && t >= 0 && t < sectionLength) {
+		double tau = (p0[0] + t * sectionDir[0] - x[0]) / direction[0];
+		if (tau != tau) {
+		    std::cout << "Tau = NaN!" << std::endl;
+		}
+		constexpr double epsilon = 0.00000001;
+		Intersection hit;
+		hit.point = p0 + sectionDir * t;
+		hit.distance = (hit.point - x).length();
+		hit.loop = segment.loop;
+		hit.segment = i;
+		hit.parameter = t / sectionLength;
+		hit.isConcaveCorner = (loop.isConcaveCorner[i] && t < epsilon) || (loop.isConcaveCorner[next] && sectionLength - t < epsilon);
+		if (tau < 0) {
+		    intersection_points.first.push_back(hit);
+		}
+		else {
+		    intersection_points.second.push_back(hit);
+		}
 	    }
-	    constexpr double epsilon = 0.00000001;
-	    if (tau < 0) {
-	    intersection_points.first.push_back(
-			std::make_pair(
-				p0 + sectionDir * t,
-				(isConcaveCorner[i] && t < epsilon) || (isConcaveCorner[(i == discretizedCurve.size() - 1)? 0 : i + 1] && sectionLength - t < epsilon)
-			)
-		);
-            }
-            else {
-                intersection_points.second.push_back(
-				std::make_pair(
-					p0 + sectionDir * t,
-					(isConcaveCorner[i] && t < epsilon) || (isConcaveCorner[(i == discretizedCurve.size() - 1)? 0 : i + 1] && sectionLength - t < epsilon)
-				)
-			);
-            }
-        }
+	}
     }
+    intersectCurves(x, direction, intersection_points);
+
     // Sort the points:
-    std::sort(intersection_points.first.begin(), intersection_points.first.end(), [x](std::pair<Geometry::Point2D, bool> p0, std::pair<Geometry::Point2D, bool> p1) { return (p0.first - x).length() < (p1.first - x).length();});
-    std::sort(intersection_points.second.begin(), intersection_points.second.end(), [x](std::pair<Geometry::Point2D, bool> p0, std::pair<Geometry::Point2D, bool> p1) { return (p0.first - x).length() < (p1.first - x).length();});
+    std::sort(intersection_points.first.begin(), intersection_points.first.end(), [](const Intersection& p0, const Intersection& p1) { return p0.distance < p1.distance; });
+    std::sort(intersection_points.second.begin(), intersection_points.second.end(), [](const Intersection& p0, const Intersection& p1) { return p0.distance < p1.distance; });
     return intersection_points;
 }
 
+void Geometry::ModifiedGordonWixomSurface::intersectCurves(const Point2D& x, const Vector2D& direction,
+							  std::pair<std::vector<Intersection>, std::vector<Intersection>>& intersections) const
+{
+    const Point3D base(x[0], x[1], 0.0);
+    const Vector3D normal(-direction[1], direction[0], 0.0);
+    for (size_t l = 0; l < loops.size(); l++) {
+	const Loop& loop = loops[l];
+	if (loop.polar) {
+	    for (double theta : loop.polar->intersectLine(x, direction)) {
+		Intersection hit;
+		hit.point = loop.polar->eval(theta);
+		hit.distance = (hit.point - x).length();
+		hit.loop = l;
+		hit.segment = 0;
+		hit.parameter = theta;
+		hit.height = 0.0;	// From the height function
+		hit.isConcaveCorner = false;	// Smooth curve
+		if ((hit.point - x) * direction < 0) {
+		    intersections.first.push_back(hit);
+		}
+		else {
+		    intersections.second.push_back(hit);
+		}
+	    }
+	    continue;
+	}
+	if (!loop.spline) {
+	    continue;
+	}
+	const double range = loop.spline->basis().high() - loop.spline->basis().low();
+	double first = 0.0;
+	double last = 0.0;
+	size_t found = 0;
+	for (size_t i = 0; i < loop.spans.size(); i++) {
+	    // The span lies in the convex hull of its control points, so it is only intersected if they are on both sides:
+	    bool above = true;
+	    bool below = true;
+	    for (const Point3D& p : loop.spans[i].controlPoints()) {
+		double side = (p - base) * normal;
+		above = above && side > 0.0;
+		below = below && side < 0.0;
+	    }
+	    if (above || below) {
+		continue;
+	    }
+	    for (double u : loop.spans[i].intersectWithPlane(base, normal)) {
+		// Roots at the joints of the spans (also the first and the last one) are found on both sides:
+		if (found > 0 && (u - last <= 1.0e-9 * range || (first - loop.spline->basis().low()) + (loop.spline->basis().high() - u) <= 1.0e-9 * range)) {
+		    continue;
+		}
+		first = (found == 0)? u : first;
+		last = u;
+		found++;
+
+		Point3D p = loop.spans[i].eval(u);
+		Intersection hit;
+		hit.point = Point2D(p[0], p[1]);
+		hit.distance = (hit.point - x).length();
+		hit.loop = l;
+		hit.segment = i;
+		hit.parameter = u;
+		hit.height = p[2];
+		hit.isConcaveCorner = false;	// Smooth curve
+		if ((hit.point - x) * direction < 0) {
+		    intersections.first.push_back(hit);
+		}
+		else {
+		    intersections.second.push_back(hit);
+		}
+	    }
+	}
+    }
+}
+
+Geometry::Vector2D Geometry::ModifiedGordonWixomSurface::tangentAt(const Intersection& hit) const
+{
+    const Loop& loop = loops[hit.loop];
+    if (loop.spline) {
+	VectorVector derivatives;
+	loop.spans[hit.segment].eval(hit.parameter, 1, derivatives);
+	return Vector2D(derivatives[1][0], derivatives[1][1]).normalize();
+    }
+    if (loop.polar) {
+	return loop.polar->derivative(hit.parameter).normalize();
+    }
+    return segmentTangent(hit.loop, hit.segment);
+}
+
+double Geometry::ModifiedGordonWixomSurface::heightAt(const Intersection& hit) const
+{
+    const Loop& loop = loops[hit.loop];
+    if (loop.spline) {
+	return hit.height;
+    }
+    if (loop.interpolation) {
+	double slope;
+	return sampledHeight(loop, hit.segment, hit.parameter, slope);
+    }
+    return loop.height(hit.point);
+}
+
+double Geometry::ModifiedGordonWixomSurface::heightSlopeAt(const Intersection& hit, const Vector2D& tangent) const
+{
+    const Loop& loop = loops[hit.loop];
+    if (loop.spline) {
+	// dz/ds = z'(u) / |(x'(u), y'(u))|, with the sign of the tangent relative to the curve direction
+	VectorVector derivatives;
+	loop.spans[hit.segment].eval(hit.parameter, 1, derivatives);
+	Vector2D velocity(derivatives[1][0], derivatives[1][1]);
+	return derivatives[1][2] * (velocity * tangent) / (velocity * velocity);
+    }
+    if (loop.interpolation) {
+	double slope;
+	sampledHeight(loop, hit.segment, hit.parameter, slope);
+	return slope * segmentTangent(hit.loop, hit.segment).dot(tangent);
+    }
+    return heightSlope(hit.loop, hit.point, tangent);
+}
+
+double Geometry::ModifiedGordonWixomSurface::fallbackHeight(const Point2D& x) const
+{
+    if (loops[0].height) {
+	return loops[0].height(x);
+    }
+    double nearest = std::numeric_limits<double>::max();
+    double h = 0.0;
+    for (const Loop& loop : loops) {
+	for (size_t i = 0; i < loop.points.size(); i++) {
+	    double distance = (loop.points[i] - x).length();
+	    if (distance < nearest) {
+		nearest = distance;
+		h = loop.height ? loop.height(loop.points[i]) : loop.pointHeights[i];
+	    }
+	}
+    }
+    return h;
+}
+
+Geometry::Vector2D Geometry::ModifiedGordonWixomSurface::segmentTangent(size_t loop, size_t i) const
+{
+    const std::vector<Point2D>& points = loops[loop].points;
+    const Point2D& p1 = points[(i == points.size() - 1)? 0 : i + 1];
+    return (p1 - points[i]).normalize();
+}
+
+double Geometry::ModifiedGordonWixomSurface::heightSlope(size_t loop, const Point2D& p, const Vector2D& tangent) const
+{
+    const double step = 1.0e-6 * (boundingRectangleMax - boundingRectangleMin).length();
+    const std::function<double(Point2D)>& height = loops[loop].height;
+    return (height(p + tangent * step) - height(p - tangent * step)) / (2.0 * step);
+}
+
+double Geometry::ModifiedGordonWixomSurface::sampledHeight(const Loop& loop, size_t i, double f, double& slope) const
+{
+    const size_t j = (i == loop.points.size() - 1)? 0 : i + 1;
+    const double h0 = loop.pointHeights[i];
+    const double h1 = loop.pointHeights[j];
+    const double length = (loop.points[j] - loop.points[i]).length();
+    if (*loop.interpolation == HeightInterpolation::Linear) {
+	slope = (h1 - h0) / length;
+	return h0 + (h1 - h0) * f;
+    }
+    // Cubic Hermite segment with the end derivatives scaled to the parameter f in [0, 1]:
+    const double m0 = loop.pointSlopes[i] * length;
+    const double m1 = loop.pointSlopes[j] * length;
+    const double f2 = f * f;
+    const double f3 = f2 * f;
+    slope = ((6.0 * f2 - 6.0 * f) * (h0 - h1) + (3.0 * f2 - 4.0 * f + 1.0) * m0 + (3.0 * f2 - 2.0 * f) * m1) / length;
+    return (2.0 * f3 - 3.0 * f2 + 1.0) * h0 + (f3 - 2.0 * f2 + f) * m0 + (3.0 * f2 - 2.0 * f3) * h1 + (f3 - f2) * m1;
+}
+
 Geometry::Point2D Geometry::ModifiedGordonWixomSurface::getBoundingRectangleMin() const
 {
     return boundingRectangleMin;
@@ -183,5 +662,10 @@ Geometry::Point2D Geometry::ModifiedGordonWixomSurface::getBoundingRectangleMax(
 
 const std::vector<Geometry::Point2D> &Geometry::ModifiedGordonWixomSurface::getDiscretizedCurve() const
 {
-    return discretizedCurve;
+    return loops[0].points;
+}
+
+const std::vector<Geometry::Point2D>& Geometry::ModifiedGordonWixomSurface::getDiscretizedLoop(size_t i) const
+{
+    return loops[i].points;
 }
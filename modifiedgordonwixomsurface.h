@@ -1,7 +1,11 @@
 #pragma once
 
 #include "geometry.hh"
+#include "polarcurve.h"
 #include <functional>
+#include <optional>
+#include <span>
+#include <vector>
 #include <utility>
 
 namespace Geometry {
@@ -9,20 +13,101 @@ namespace Geometry {
   class ModifiedGordonWixomSurface
   {
   public:
+    /*
+     * How the heights of a sampled boundary loop are interpolated between its samples.
+    */
+    enum class HeightInterpolation { Linear, Cubic };
+
     /*
      * Receives a function: t in [0, 1] -> R^3 describing a closed curve
      * The surface will interpolated inside the closed curve
     */
     ModifiedGordonWixomSurface(const std::function<Point2D(double)>& curve, const std::function<double(Point2D)>& height);
 
+    /*
+     * Receives a closed B-spline curve: its x and y coordinates are the boundary and z is the height on it
+     * Lines are intersected with the curve itself (not its discretization), piece by piece in Bezier form.
+    */
+    explicit ModifiedGordonWixomSurface(const BSCurve& curve);
+
+    /*
+     * Receives a closed curve in polar form; lines are intersected with it exactly by root isolation on its radius,
+     * after culling by its annulus.
+    */
+    ModifiedGordonWixomSurface(const PolarCurve& curve, const std::function<double(Point2D)>& height);
+
+    /*
+     * Receives a closed boundary sampled as points (x, y, height), in order and without repeating the first one.
+     * The samples are used as the discretized curve (regardless of the curve resolution), and the height at an
+     * intersection is interpolated along its segment: linearly, or by a Catmull-Rom spline over the arc length.
+    */
+    explicit ModifiedGordonWixomSurface(const PointVector& samples, HeightInterpolation interpolation = HeightInterpolation::Cubic);
+
+    /*
+     * The same for samples stored elsewhere, e.g. the loops of a boundary file (boundaryreader.h).
+    */
+    explicit ModifiedGordonWixomSurface(std::span<const Point3D> samples, HeightInterpolation interpolation = HeightInterpolation::Cubic);
+
     double eval(const Point2D& x) const;
 
+    /*
+     * Returns the value and the gradient of the surface at x, computed in the same angular integration as eval
+     * by differentiating it with respect to x.
+    */
+    std::pair<double, Vector2D> evalWithGradient(const Point2D& x) const;
+
+    /*
+     * Replaces the outer curve. The heights of a B-spline or sampled outer loop are dropped with it,
+     * so such a surface needs setHeight as well before it is evaluated.
+    */
     void setCurve(const std::function<Point2D(double)>& curve);
 
     void setHeight(const std::function<double(Point2D)>& curve);
 
     /*
-     * Returns a pair of arrays of intersection points
+     * Adds an inner boundary loop (a hole), a closed curve t in [0, 1] -> R^2 inside the outer one, with its own height function.
+     * The surface then interpolates over the multiply-connected domain between the loops.
+    */
+    void addInnerLoop(const std::function<Point2D(double)>& curve, const std::function<double(Point2D)>& height);
+
+    /*
+     * Adds an inner boundary loop given as a closed B-spline curve, with z as the height (see the constructor).
+    */
+    void addInnerLoop(const BSCurve& curve);
+
+    /*
+     * Adds an inner boundary loop in polar form, with its own height function.
+    */
+    void addInnerLoop(const PolarCurve& curve, const std::function<double(Point2D)>& height);
+
+    /*
+     * Adds an inner boundary loop sampled as points (x, y, height) (see the constructor).
+    */
+    void addInnerLoop(const PointVector& samples, HeightInterpolation interpolation = HeightInterpolation::Cubic);
+
+    void addInnerLoop(std::span<const Point3D> samples, HeightInterpolation interpolation = HeightInterpolation::Cubic);
+
+    /*
+     * Number of boundary loops: the outer one and the inner ones.
+    */
+    size_t getLoopCount() const;
+
+    /*
+     * Number of line directions sampled over [0, pi) by eval (quality / speed trade-off), at least 1.
+    */
+    void setDirectionCount(int n);
+
+    int getDirectionCount() const;
+
+    /*
+     * Number of points the curve is discretized into, at least 3; rediscretizes the curve.
+    */
+    void setCurveResolution(int n);
+
+    int getCurveResolution() const;
+
+    /*
+     * Returns a pair of arrays of intersection points with all boundary loops, each sorted by the distance from x
      * Points in the first array of the pair are on the oposite side of the line related to the x point than the points in the second array of the pair.
     */
     std::pair<std::vector<std::pair<Geometry::Point2D, bool>>, std::vector<std::pair<Geometry::Point2D, bool>>>
@@ -32,16 +117,127 @@ namespace Geometry {
 
     Point2D getBoundingRectangleMax() const;
 
+    /*
+     * The discretized outer curve.
+    */
     const std::vector<Point2D>& getDiscretizedCurve() const;
 
+    /*
+     * The discretized loop i (0 is the outer curve, the others are the inner loops in the order they were added).
+    */
+    const std::vector<Point2D>& getDiscretizedLoop(size_t i) const;
+
 private:
+    struct Loop {
+	std::function<Point2D(double)> curve;
+	std::function<double(Point2D)> height;	// Empty for B-spline and sampled loops
+	std::optional<BSCurve> spline;
+	std::vector<BSCurve> spans;		// Bezier pieces of the spline, intersected instead of the segments
+	std::optional<PolarCurve> polar;	// Intersected instead of the segments
+	std::optional<HeightInterpolation> interpolation;	// Only for sampled loops, whose points are the samples
+	std::vector<Point2D> points;		// The discretized curve
+	std::vector<double> pointHeights;	// Heights at the points, for loops without a height function
+	std::vector<double> pointSlopes;	// Derivatives of the height by arc length at the points, for cubic interpolation
+	std::vector<bool> isConcaveCorner;
+    };
+
+    /*
+     * Segment of a discretized loop, from point index to the next one, with its direction and length precomputed.
+    */
+    struct Segment {
+	Point2D start;
+	Vector2D direction;
+	double length;
+	size_t loop;
+	size_t index;
+    };
+
+    /*
+     * Bounding box of a run of consecutive segments (of one loop), so lines can skip all of them at once.
+    */
+    struct SegmentChunk {
+	Point2D center;
+	Vector2D halfSize;
+	size_t begin;
+	size_t end;
+    };
+
+    static constexpr size_t chunkSize = 16;
+
+    struct Intersection {
+	Point2D point;
+	double distance;	// from the line's base point
+	size_t loop;
+	size_t segment;		// index of the segment's first point in the loop's discretized curve (or of the spline span)
+	double parameter;	// of the spline (or the angle of the polar curve, or the fraction of the segment) at the point
+	double height;		// of the spline at the point
+	bool isConcaveCorner;
+    };
+
     void discretizeCurve();
 
+    void discretizeLoop(Loop& loop) const;
+
+    static Loop splineLoop(const BSCurve& curve);
+
+    static Loop polarLoop(const PolarCurve& curve, const std::function<double(Point2D)>& height);
+
+    static Loop sampledLoop(std::span<const Point3D> samples, HeightInterpolation interpolation);
+
+    /*
+     * Rebuilds the segments, their chunks, the bounding rectangle and the concave corners after a loop has changed.
+    */
+    void buildSegments();
+
+    /*
+     * Same as findLineCurveIntersections, also keeping the distance and the intersected segment.
+    */
+    std::pair<std::vector<Intersection>, std::vector<Intersection>> intersectLine(const Point2D& x, const Vector2D& direction) const;
+
+    /*
+     * Value of the surface at x; also its gradient if gradient is not null.
+    */
+    double integrate(const Point2D& x, Vector2D* gradient) const;
+
+    /*
+     * Appends the intersections of the line with the spline and polar loops.
+    */
+    void intersectCurves(const Point2D& x, const Vector2D& direction,
+			 std::pair<std::vector<Intersection>, std::vector<Intersection>>& intersections) const;
+
+    /*
+     * Unit tangent, height and its derivative along that tangent at an intersection with any kind of loop.
+    */
+    Vector2D tangentAt(const Intersection& hit) const;
+
+    double heightAt(const Intersection& hit) const;
+
+    double heightSlopeAt(const Intersection& hit, const Vector2D& tangent) const;
+
+    /*
+     * Height of the boundary for points where the integration fails: the outer height function, or the height of the
+     * nearest discretized boundary point.
+    */
+    double fallbackHeight(const Point2D& x) const;
+
+    Vector2D segmentTangent(size_t loop, size_t i) const;
+
+    /*
+     * Derivative of the height function of the loop at its curve point p in the direction of the curve tangent.
+    */
+    double heightSlope(size_t loop, const Point2D& p, const Vector2D& tangent) const;
+
+    /*
+     * Height of a sampled loop at the fraction f of its segment i, and its derivative by arc length along the segment.
+    */
+    double sampledHeight(const Loop& loop, size_t i, double f, double& slope) const;
+
     Point2D boundingRectangleMin;
     Point2D boundingRectangleMax;
-    std::function<Geometry::Point2D(double)> curve;
-    std::function<double(Point2D)> height;
-    std::vector<Point2D> discretizedCurve;
-    std::vector<bool> isConcaveCorner;
+    std::vector<Loop> loops;		// The outer curve first
+    std::vector<Segment> segments;	// Of all loops, in order
+    std::vector<SegmentChunk> chunks;
+    int directionCount = 128;
+    int curveResolution = 256;
   };
 }
@@ -0,0 +1,130 @@
+#include "parallel.h"
+
+namespace {
+
+    std::atomic<size_t> requestedThreadCount{0};
+}
+
+struct Geometry::ThreadPool::Loop {
+    std::function<void()> task;
+    size_t helpers;		// Workers that may still join
+};
+
+Geometry::ThreadPool& Geometry::ThreadPool::shared()
+{
+    static ThreadPool pool([] {
+	size_t n = requestedThreadCount.load();
+	if (n == 0) {
+	    n = std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+	return n - 1;
+    }());
+    return pool;
+}
+
+void Geometry::ThreadPool::setThreadCount(size_t n)
+{
+    requestedThreadCount = std::max<size_t>(1, n);
+}
+
+Geometry::ThreadPool::ThreadPool(size_t workerCount)
+{
+    workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; i++) {
+	workers.emplace_back([this]() { work(); });
+    }
+    // Otherwise the first loops would only get the workers that happen to be waiting already:
+    std::unique_lock<std::mutex> lock(mutex);
+    ready.wait(lock, [this, workerCount]() { return idle == workerCount; });
+}
+
+Geometry::ThreadPool::~ThreadPool()
+{
+    {
+	std::lock_guard<std::mutex> lock(mutex);
+	stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread& worker : workers) {
+	worker.join();
+    }
+}
+
+size_t Geometry::ThreadPool::threadCount() const
+{
+    return workers.size() + 1;
+}
+
+size_t Geometry::ThreadPool::offer(const std::function<void()>& task, size_t count)
+{
+    size_t offered;
+    {
+	std::lock_guard<std::mutex> lock(mutex);
+	// Every queued task is already promised to one of the idle workers:
+	offered = std::min(count, idle - std::min(idle, tasks.size()));
+	for (size_t i = 0; i < offered; i++) {
+	    tasks.push_back(task);
+	}
+    }
+    for (size_t i = 0; i < offered; i++) {
+	wakeup.notify_one();
+    }
+    return offered;
+}
+
+std::shared_ptr<Geometry::ThreadPool::Loop> Geometry::ThreadPool::open(const std::function<void()>& task, size_t count)
+{
+    auto loop = std::make_shared<Loop>(Loop{ task, count });
+    if (count == 0) {
+	return loop;
+    }
+    size_t waiting;
+    {
+	std::lock_guard<std::mutex> lock(mutex);
+	loops.push_back(loop);
+	waiting = std::min(count, idle - std::min(idle, tasks.size()));
+    }
+    for (size_t i = 0; i < waiting; i++) {
+	wakeup.notify_one();
+    }
+    return loop;
+}
+
+void Geometry::ThreadPool::close(const std::shared_ptr<Loop>& loop)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find(loops.begin(), loops.end(), loop);
+    if (it != loops.end()) {
+	loops.erase(it);
+    }
+}
+
+void Geometry::ThreadPool::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle++;
+    ready.notify_one();
+    while (true) {
+	wakeup.wait(lock, [this]() { return stopping || !tasks.empty() || !loops.empty(); });
+	idle--;
+	if (stopping) {
+	    return;
+	}
+	if (!tasks.empty()) {
+	    std::function<void()> task = std::move(tasks.front());
+	    tasks.pop_front();
+	    lock.unlock();
+	    task();
+	}
+	else {
+	    std::shared_ptr<Loop> loop = loops.front();
+	    if (--loop->helpers == 0) {
+		loops.pop_front();
+	    }
+	    lock.unlock();
+	    loop->task();
+	}
+	lock.lock();
+	idle++;
+    }
+}
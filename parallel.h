@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Geometry {
+
+  /*
+   * Worker threads shared by all parallel loops of the process: one less than the thread count, as the thread starting
+   * a loop works on it as well. Tasks are only handed to idle workers, so loops started inside other parallel work
+   * (e.g. evaluating the heights of one of many surfaces written concurrently) use the threads that are left over
+   * and otherwise run inline, instead of oversubscribing the machine; workers that become idle later join the loops
+   * still running.
+  */
+  class ThreadPool
+  {
+  public:
+    static ThreadPool& shared();
+
+    /*
+     * Number of threads parallel loops use (including the caller; default: the hardware threads).
+     * Only takes effect before the first parallel loop.
+    */
+    static void setThreadCount(size_t n);
+
+    size_t threadCount() const;
+
+    /*
+     * Queues task for up to count idle workers (each runs it once); returns how many will run it.
+    */
+    size_t offer(const std::function<void()>& task, size_t count);
+
+    struct Loop;
+
+    /*
+     * Lets up to count workers run task (each once): the idle ones right away, and the others as they become idle,
+     * until the loop is closed. Promised tasks of offer() go first.
+    */
+    std::shared_ptr<Loop> open(const std::function<void()>& task, size_t count);
+
+    void close(const std::shared_ptr<Loop>& loop);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+  private:
+    explicit ThreadPool(size_t workerCount);
+
+    void work();
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable ready;	// For the constructor, until every worker waits
+    std::deque<std::function<void()>> tasks;
+    std::deque<std::shared_ptr<Loop>> loops;	// Open loops that workers may still join
+    std::vector<std::thread> workers;
+    size_t idle = 0;		// Workers waiting for a task
+    bool stopping = false;
+  };
+
+  /*
+   * Calls f(i) for every i in [0, n) on the calling thread and the idle workers of the shared pool.
+   * Indices are handed out dynamically in chunks of grain, so uneven costs (e.g. eval near concave corners) balance out.
+  */
+  template <typename F>
+  void parallelFor(size_t n, F&& f, size_t grain = 64)
+  {
+    ThreadPool& pool = ThreadPool::shared();
+    const size_t chunks = (n + grain - 1) / grain;
+    if (pool.threadCount() <= 1 || chunks <= 1) {
+	for (size_t i = 0; i < n; i++) {
+	    f(i);
+	}
+	return;
+    }
+
+    // Helpers may only start after the loop is done; they find no chunk left then and never touch f.
+    struct State {
+	std::atomic<size_t> next{0};
+	std::atomic<size_t> active{0};
+	std::mutex mutex;
+	std::condition_variable done;
+    };
+    auto state = std::make_shared<State>();
+    auto* body = &f;
+    auto work = [state, body, n, grain]() {
+	state->active++;
+	for (size_t begin = state->next.fetch_add(grain); begin < n; begin = state->next.fetch_add(grain)) {
+	    size_t end = std::min(n, begin + grain);
+	    for (size_t i = begin; i < end; i++) {
+		(*body)(i);
+	    }
+	}
+	if (--state->active == 0) {
+	    std::lock_guard<std::mutex> lock(state->mutex);
+	    state->done.notify_all();
+	}
+    };
+    auto loop = pool.open(work, std::min(pool.threadCount(), chunks) - 1);
+    work();
+    // All chunks are taken; wait for the helpers still working on one:
+    pool.close(loop);
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state]() { return state->active.load() == 0; });
+  }
+}
@@ -0,0 +1,112 @@
+#include "perfcounters.h"
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+    int openCounter(uint32_t type, uint64_t config)
+    {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.inherit = 1;		// Count worker threads spawned inside the measured region too.
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    constexpr uint64_t cacheConfig(uint64_t cache, uint64_t op, uint64_t result)
+    {
+	return cache | (op << 8) | (result << 16);
+    }
+}
+
+Benchmark::PerfCounters::PerfCounters(bool enabled)
+{
+    fds.fill(-1);
+    if (!enabled) {
+	return;
+    }
+    fds[Cycles] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[Instructions] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[BranchMisses] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[L1DMisses] = openCounter(PERF_TYPE_HW_CACHE,
+				 cacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    fds[LLCMisses] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+}
+
+Benchmark::PerfCounters::~PerfCounters()
+{
+    for (int fd : fds) {
+	if (fd >= 0) {
+	    close(fd);
+	}
+    }
+}
+
+bool Benchmark::PerfCounters::available() const
+{
+    for (int fd : fds) {
+	if (fd >= 0) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+bool Benchmark::PerfCounters::available(Event e) const
+{
+    return fds[e] >= 0;
+}
+
+void Benchmark::PerfCounters::start()
+{
+    for (int fd : fds) {
+	if (fd >= 0) {
+	    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+}
+
+Benchmark::PerfCounters::Sample Benchmark::PerfCounters::stop()
+{
+    Sample sample;
+    for (int i = 0; i < EventCount; i++) {
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+    }
+    for (int i = 0; i < EventCount; i++) {
+	if (fds[i] < 0) {
+	    continue;
+	}
+	uint64_t data[3];	// value, time enabled, time running
+	if (read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+	    continue;	// Never scheduled on the PMU: no meaningful value.
+	}
+	sample.value[i] = static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+	sample.valid[i] = true;
+    }
+    return sample;
+}
+
+const char* Benchmark::PerfCounters::name(Event e)
+{
+    switch (e) {
+    case Cycles:	return "cycles";
+    case Instructions:	return "instructions";
+    case BranchMisses:	return "branch-misses";
+    case L1DMisses:	return "L1D-misses";
+    case LLCMisses:	return "LLC-misses";
+    default:		return "?";
+    }
+}
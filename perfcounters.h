@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace Benchmark {
+
+  /*
+   * Thin wrapper around Linux perf_event_open() hardware counters.
+   * Counters that cannot be opened (no PMU access, restrictive perf_event_paranoid, VM without
+   * virtualized counters, ...) are reported as unavailable instead of failing the measurement.
+  */
+  class PerfCounters
+  {
+  public:
+    enum Event { Cycles, Instructions, BranchMisses, L1DMisses, LLCMisses, EventCount };
+
+    struct Sample {
+	std::array<double, EventCount> value{};		// Scaled by enabled / running time when multiplexed.
+	std::array<bool, EventCount> valid{};
+
+	bool has(Event e) const { return valid[e]; }
+	double operator[](Event e) const { return value[e]; }
+    };
+
+    /*
+     * Opens the counters for the calling thread and threads it creates afterwards.
+     * If enabled is false, no counter is opened and every sample is invalid.
+    */
+    explicit PerfCounters(bool enabled = true);
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+
+    bool available(Event e) const;
+
+    void start();
+
+    Sample stop();
+
+    static const char* name(Event e);
+
+  private:
+    std::array<int, EventCount> fds;
+  };
+}
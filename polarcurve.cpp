@@ -0,0 +1,171 @@
+#include "polarcurve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+Geometry::PolarCurve::PolarCurve(const Point2D& _center, double _r0, const std::vector<Harmonic>& _harmonics)
+    : center(_center), r0(_r0), harmonics(_harmonics)
+{
+    // |g'| <= |r'| + |r| and |g''| <= |r''| + 2 |r'| + |r|:
+    lipschitz = r0;
+    curvature = r0;
+    for (const Harmonic& h : harmonics) {
+	double a = std::abs(h.amplitude);
+	double k = std::abs(h.frequency);
+	amplitudeSum += a;
+	lipschitz += a * (1.0 + k);
+	curvature += a * (1.0 + k) * (1.0 + k);
+    }
+    if (r0 <= amplitudeSum) {
+	throw std::invalid_argument("PolarCurve: the radius has to stay positive");
+    }
+}
+
+double Geometry::PolarCurve::radius(double theta) const
+{
+    double r = r0;
+    for (const Harmonic& h : harmonics) {
+	r += h.amplitude * std::sin(h.frequency * theta + h.phase);
+    }
+    return r;
+}
+
+void Geometry::PolarCurve::radiusDerivatives(double theta, double& r, double& dr, double& ddr) const
+{
+    r = r0;
+    dr = 0.0;
+    ddr = 0.0;
+    for (const Harmonic& h : harmonics) {
+	double s = std::sin(h.frequency * theta + h.phase);
+	double c = std::cos(h.frequency * theta + h.phase);
+	r += h.amplitude * s;
+	dr += h.amplitude * h.frequency * c;
+	ddr -= h.amplitude * h.frequency * h.frequency * s;
+    }
+}
+
+Geometry::Point2D Geometry::PolarCurve::eval(double theta) const
+{
+    double r = radius(theta);
+    return center + Vector2D(std::cos(theta), std::sin(theta)) * r;
+}
+
+Geometry::Vector2D Geometry::PolarCurve::derivative(double theta) const
+{
+    double r, dr, ddr;
+    radiusDerivatives(theta, r, dr, ddr);
+    double c = std::cos(theta);
+    double s = std::sin(theta);
+    return Vector2D(dr * c - r * s, dr * s + r * c);
+}
+
+double Geometry::PolarCurve::minRadius() const
+{
+    return r0 - amplitudeSum;
+}
+
+double Geometry::PolarCurve::maxRadius() const
+{
+    return r0 + amplitudeSum;
+}
+
+std::vector<double> Geometry::PolarCurve::intersectLine(const Point2D& x, const Vector2D& direction) const
+{
+    std::vector<double> roots;
+    Vector2D normal(-direction[1], direction[0]);
+    double length = normal.length();
+    if (length == 0.0) {
+	return roots;
+    }
+    double psi = std::atan2(normal[1], normal[0]);
+    double s = (normal * (x - center)) / length;
+    if (s < 0.0) {
+	psi += M_PI;
+	s = -s;
+    }
+    if (s > maxRadius()) {	// The line misses the annulus.
+	return roots;
+    }
+
+    // cos(theta - psi) = s / r(theta) with r in [minRadius, maxRadius], widened a little as the roots may lie at the ends
+    // (for a constant radius the windows are single points):
+    constexpr double margin = 1.0e-6;
+    double inner = (s >= minRadius()) ? 0.0 : std::max(0.0, std::acos(s / minRadius()) - margin);
+    double outer = std::acos(s / maxRadius()) + margin;
+    auto g = [&](double theta) { return radius(theta) * std::cos(theta - psi) - s; };
+    isolateRoots(psi, s, psi - outer, psi - inner, g(psi - outer), g(psi - inner), roots, 0);
+    isolateRoots(psi, s, psi + inner, psi + outer, g(psi + inner), g(psi + outer), roots, 0);
+
+    for (double& theta : roots) {
+	theta = std::fmod(theta, 2.0 * M_PI);
+	if (theta < 0.0) {
+	    theta += 2.0 * M_PI;
+	}
+    }
+    std::sort(roots.begin(), roots.end());
+    return roots;
+}
+
+/*
+ * Roots in [a, b) (a root at b belongs to the next interval); ga and gb are the values of g at the ends.
+*/
+void Geometry::PolarCurve::isolateRoots(double psi, double s, double a, double b, double ga, double gb,
+					std::vector<double>& roots, int depth) const
+{
+    const double h = (b - a) / 2.0;
+    const double m = a + h;
+    double r, dr, ddr;
+    radiusDerivatives(m, r, dr, ddr);
+    double c = std::cos(m - psi);
+    double sn = std::sin(m - psi);
+    double g = r * c - s;
+    double dg = dr * c - r * sn;
+    if (std::abs(g) > lipschitz * h) {
+	return;
+    }
+    if (std::abs(dg) > curvature * h || depth > 48) {
+	// Monotone (or too small to tell): at most one root, exactly if the sign changes.
+	if (!(ga == 0.0 || (ga < 0.0) != (gb < 0.0)) || gb == 0.0) {
+	    return;
+	}
+	// Below the rounding error of g its sign says nothing about the side of the root any more:
+	const double tolerance = 4.0 * std::numeric_limits<double>::epsilon() * maxRadius();
+	double lo = a;
+	double hi = b;
+	double theta = m;
+	for (int iteration = 0; iteration < 64 && ga != 0.0; iteration++) {
+	    if (iteration > 0) {
+		radiusDerivatives(theta, r, dr, ddr);
+		c = std::cos(theta - psi);
+		sn = std::sin(theta - psi);
+		g = r * c - s;
+		dg = dr * c - r * sn;
+	    }
+	    if (std::abs(g) <= tolerance) {
+		break;
+	    }
+	    if ((g < 0.0) == (ga < 0.0)) {
+		lo = theta;
+	    }
+	    else {
+		hi = theta;
+	    }
+	    double next = theta - g / dg;
+	    if (!(next > lo && next < hi)) {	// Bisect where Newton leaves the bracket.
+		next = (lo + hi) / 2.0;
+	    }
+	    bool converged = std::abs(next - theta) <= 4.0 * std::numeric_limits<double>::epsilon() * (1.0 + std::abs(theta));
+	    theta = next;
+	    if (converged) {
+		break;
+	    }
+	}
+	roots.push_back(ga == 0.0 ? a : theta);
+	return;
+    }
+    double gm = g;
+    isolateRoots(psi, s, a, m, ga, gm, roots, depth + 1);
+    isolateRoots(psi, s, m, b, gm, gb, roots, depth + 1);
+}
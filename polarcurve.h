@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.hh"
+
+namespace Geometry {
+
+  /*
+   * Closed curve given in polar form around center: r(theta) = r0 + sum_k a_k * sin(k * theta + phi_k), theta in [0, 2 pi).
+   * The radius has to stay positive (r0 > sum_k |a_k|), so the curve is star-shaped with respect to center.
+  */
+  class PolarCurve
+  {
+  public:
+    struct Harmonic {
+	int frequency;		// k
+	double amplitude;	// a_k
+	double phase;		// phi_k
+    };
+
+    PolarCurve(const Point2D& center, double r0, const std::vector<Harmonic>& harmonics);
+
+    double radius(double theta) const;
+
+    Point2D eval(double theta) const;
+
+    /*
+     * Derivative of the curve point with respect to theta.
+    */
+    Vector2D derivative(double theta) const;
+
+    /*
+     * Radii of the annulus around center containing the curve (r0 -/+ sum_k |a_k|).
+    */
+    double minRadius() const;
+
+    double maxRadius() const;
+
+    /*
+     * Angles in [0, 2 pi) where the curve meets the line through x with the given direction, sorted.
+     * With s the signed distance of center from the line and psi the angle of the line's normal, the roots of
+     * g(theta) = r(theta) * cos(theta - psi) - s can only lie where the annulus meets the line, which bounds the
+     * search to two angular windows; there intervals are dropped when |g| exceeds its Lipschitz bound, solved by
+     * Newton iteration once g is monotone (by the bound on g''), and split otherwise.
+    */
+    std::vector<double> intersectLine(const Point2D& x, const Vector2D& direction) const;
+
+  private:
+    /*
+     * r and its first two derivatives.
+    */
+    void radiusDerivatives(double theta, double& r, double& dr, double& ddr) const;
+
+    void isolateRoots(double psi, double s, double a, double b, double ga, double gb, std::vector<double>& roots, int depth) const;
+
+    Point2D center;
+    double r0;
+    std::vector<Harmonic> harmonics;
+    double amplitudeSum = 0.0;	// sum_k |a_k|
+    double lipschitz = 0.0;	// bound of |g'|
+    double curvature = 0.0;	// bound of |g''|
+  };
+}
@@ -0,0 +1,158 @@
+#include "polarmesh.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    // First triangle of the band between rings k - 1 and k (a fan around the center for k = 1).
+    size_t bandStart(const std::vector<size_t>& ringSize, size_t k)
+    {
+	size_t first = 0;
+	for (size_t l = 1; l < k; l++) {
+	    first += (l == 1) ? ringSize[1] : ringSize[l - 1] + ringSize[l];
+	}
+	return first;
+    }
+
+    void buildRings(const std::vector<Geometry::Point2D>& polygon, const Geometry::Point2D& center, const std::vector<size_t>& ringSize,
+		    Geometry::TriMesh& mesh, std::vector<Geometry::TriMesh::Triangle>& triangles)
+    {
+	using namespace Geometry;
+	const size_t n = polygon.size();
+	const size_t rings = ringSize.size() - 1;
+
+	// Ring k starts at vertex firstVertex[k], the band between rings k - 1 and k at triangle firstTriangle[k]:
+	std::vector<size_t> firstVertex(rings + 2, 0), firstTriangle(rings + 2, 0);
+	for (size_t k = 0; k <= rings; k++) {
+	    firstVertex[k + 1] = firstVertex[k] + ringSize[k];
+	    firstTriangle[k + 1] = bandStart(ringSize, k + 1);
+	}
+
+	mesh.resizePoints(firstVertex[rings + 1]);
+	mesh[0] = Point3D(center[0], 0.0, center[1]);
+	parallelFor(rings, [&](size_t r) {
+	    const size_t k = r + 1;
+	    const double scale = static_cast<double>(k) / rings;
+	    for (size_t j = 0; j < ringSize[k]; j++) {
+		// Parameter along the polygon, in units of its vertices:
+		double s = static_cast<double>(j) * n / ringSize[k];
+		size_t i = std::min(static_cast<size_t>(s), n - 1);
+		double f = s - i;
+		Point2D p = polygon[i] * (1.0 - f) + polygon[(i + 1) % n] * f;
+		Point2D q = center + (p - center) * scale;
+		mesh[firstVertex[k] + j] = Point3D(q[0], 0.0, q[1]);
+	    }
+	}, 1);
+
+	triangles.resize(firstTriangle[rings + 1]);
+	parallelFor(rings, [&](size_t r) {
+	    const size_t k = r + 1;
+	    TriMesh::Triangle* t = &triangles[firstTriangle[k]];
+	    const int b = static_cast<int>(ringSize[k]);
+	    const int outer = static_cast<int>(firstVertex[k]);
+	    if (k == 1) {
+		for (int j = 0; j < b; j++) {
+		    *t++ = { 0, outer + j, outer + (j + 1) % b };
+		}
+		return;
+	    }
+	    // Zip the rings together by parameter, always advancing on the ring whose next vertex comes first:
+	    const int a = static_cast<int>(ringSize[k - 1]);
+	    const int inner = static_cast<int>(firstVertex[k - 1]);
+	    for (int i = 0, j = 0; i < a || j < b; ) {
+		if (j == b || (i < a && static_cast<long long>(i + 1) * b < static_cast<long long>(j + 1) * a)) {
+		    *t++ = { inner + i, outer + j % b, inner + (i + 1) % a };
+		    i++;
+		}
+		else {
+		    *t++ = { inner + i % a, outer + j, outer + (j + 1) % b };
+		    j++;
+		}
+	    }
+	}, 1);
+    }
+}
+
+bool Geometry::isStarShaped(const std::vector<Point2D>& polygon, const Point2D& center)
+{
+    const size_t n = polygon.size();
+    if (n < 3) {
+	return false;
+    }
+    // The angle around center has to change monotonically and add up to one full turn:
+    double sign = 0.0;
+    double angle = 0.0;
+    for (size_t i = 0; i < n; i++) {
+	Vector2D a = polygon[i] - center;
+	Vector2D b = polygon[(i + 1) % n] - center;
+	double cross = a[0] * b[1] - a[1] * b[0];
+	if (cross == 0.0 || cross * sign < 0.0) {
+	    return false;
+	}
+	sign = cross;
+	angle += std::atan2(cross, a * b);
+    }
+    return std::abs(angle) > M_PI;
+}
+
+Geometry::TriMesh Geometry::polarMesh(const std::vector<Point2D>& polygon, const Point2D& center, double maxArea)
+{
+    const size_t n = polygon.size();
+    double perimeter = 0.0;
+    double meanRadius = 0.0;
+    double signedArea = 0.0;
+    for (size_t i = 0; i < n; i++) {
+	const Point2D& p = polygon[i];
+	const Point2D& q = polygon[(i + 1) % n];
+	perimeter += (q - p).norm();
+	meanRadius += (p - center).norm() / n;
+	signedArea += (p[0] - center[0]) * (q[1] - center[1]) - (p[1] - center[1]) * (q[0] - center[0]);
+    }
+
+    // Rings h apart with vertices h apart, i.e. quads of area maxArea split in two:
+    const double h = std::sqrt(2.0 * maxArea);
+    const size_t rings = std::max<size_t>(1, static_cast<size_t>(std::lround(meanRadius / h)));
+    std::vector<size_t> ringSize(rings + 1, 1);	// Ring 0 is the center.
+    for (size_t k = 1; k < rings; k++) {
+	double length = perimeter * k / rings;
+	ringSize[k] = std::clamp<size_t>(static_cast<size_t>(std::ceil(length / h)), 3, n);
+    }
+    ringSize[rings] = n;
+
+    // Coarse inner rings may cut across deep lobes of the polygon and invert triangles; the inner ring of such bands
+    // is refined until none is left (at the latest when all rings are as fine as the polygon, as then the bands
+    // consist of trapezoids).
+    TriMesh mesh;
+    std::vector<TriMesh::Triangle> triangles;
+    for (bool inverted = true; inverted; ) {
+	buildRings(polygon, center, ringSize, mesh, triangles);
+	std::vector<char> invertedBand(rings + 1, 0);
+	parallelFor(rings, [&](size_t r) {
+	    const size_t k = r + 1;
+	    for (size_t i = bandStart(ringSize, k); i < bandStart(ringSize, k + 1) && !invertedBand[k]; i++) {
+		const Point3D& a = mesh[triangles[i][0]];
+		const Point3D& b = mesh[triangles[i][1]];
+		const Point3D& c = mesh[triangles[i][2]];
+		double area = (b[0] - a[0]) * (c[2] - a[2]) - (b[2] - a[2]) * (c[0] - a[0]);
+		invertedBand[k] = area * signedArea <= 0.0;
+	    }
+	}, 1);
+	inverted = false;
+	for (size_t k = 1; k <= rings; k++) {
+	    if (invertedBand[k]) {
+		size_t& coarse = (k > 1 && ringSize[k - 1] < n) ? ringSize[k - 1] : ringSize[k];
+		inverted = inverted || coarse < n;
+		coarse = std::min(n, 2 * coarse);
+	    }
+	}
+    }
+    if (signedArea < 0.0) {	// Clockwise polygon
+	for (TriMesh::Triangle& t : triangles) {
+	    std::swap(t[1], t[2]);
+	}
+    }
+    mesh.setTriangles(triangles);
+    return mesh;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.hh"
+
+namespace Geometry {
+
+  /*
+   * True if every ray from center crosses the closed polygon exactly once (center is in its kernel).
+  */
+  bool isStarShaped(const std::vector<Point2D>& polygon, const Point2D& center);
+
+  /*
+   * Structured mesh of a star-shaped polygon without Triangle: rings are the polygon scaled towards center,
+   * ring k of K with about k / K times as many vertices as the polygon (the outermost ring is the polygon itself),
+   * and neighbouring rings are stitched by their common parameter along the polygon (inner rings are refined where
+   * they would cut across deep lobes and invert triangles).
+   * The vertex count, 1 + the sum of the ring sizes, only depends on the polygon and maxArea, and the mesh is built in parallel.
+   * Points are (x, 0, y) like in write_geometry; triangles are counterclockwise in the plane.
+  */
+  TriMesh polarMesh(const std::vector<Point2D>& polygon, const Point2D& center, double maxArea);
+}
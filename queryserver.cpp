@@ -0,0 +1,547 @@
+#include "queryserver.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "boundaryreader.h"
+#include "parallel.h"
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Header {
+	uint32_t size;		// Of the rest of the frame
+	uint8_t code;		// Query::Op or Query::Status
+	uint8_t flags;
+	uint16_t reserved;
+	uint32_t tag;
+	uint32_t value;		// Surface id or microseconds
+    };
+
+    static_assert(sizeof(Header) == Geometry::Query::headerSize);
+
+    const char* opNames[] = { "unknown", "load", "load-file", "eval", "unload", "stats", "shm-eval" };
+
+    // Reads exactly size bytes; false at the end of the input or on an error.
+    bool readFully(int fd, char* data, size_t size)
+    {
+	while (size > 0) {
+	    ssize_t n = read(fd, data, size);
+	    if (n < 0 && errno == EINTR) {
+		continue;
+	    }
+	    if (n <= 0) {
+		return false;
+	    }
+	    data += n;
+	    size -= n;
+	}
+	return true;
+    }
+
+    // Waits until fd has input (or has ended); false if the wakeup eventfd fired first.
+    bool waitForInput(int fd, int wakeup)
+    {
+	pollfd fds[2] = { { fd, POLLIN, 0 }, { wakeup, POLLIN, 0 } };
+	while (true) {
+	    if (poll(fds, 2, -1) < 0) {
+		if (errno == EINTR) {
+		    continue;
+		}
+		return false;
+	    }
+	    return fds[1].revents == 0;
+	}
+    }
+
+    // Reads a whole frame (header and payload); false at the end of the input, if the frame size is out of range,
+    // or on wakeup between frames.
+    bool readFrame(int fd, int wakeup, std::vector<char>& frame)
+    {
+	uint32_t size;
+	if (!waitForInput(fd, wakeup) || !readFully(fd, reinterpret_cast<char*>(&size), sizeof(size))) {
+	    return false;
+	}
+	if (size < Geometry::Query::headerSize - sizeof(size) || size > Geometry::Query::maxFrameSize) {
+	    std::fprintf(stderr, "Invalid frame size %u, closing the connection.\n", size);
+	    return false;
+	}
+	frame.resize(sizeof(size) + size);
+	std::memcpy(frame.data(), &size, sizeof(size));
+	return readFully(fd, frame.data() + sizeof(size), size);
+    }
+
+    std::vector<char> responseFrame(Geometry::Query::Status status, uint32_t tag, Clock::time_point start, const void* payload,
+				    size_t size)
+    {
+	uint64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+	Header header{};
+	header.size = static_cast<uint32_t>(Geometry::Query::headerSize - sizeof(header.size) + size);
+	header.code = static_cast<uint8_t>(status);
+	header.tag = tag;
+	header.value = static_cast<uint32_t>(std::min<uint64_t>(microseconds, UINT32_MAX));
+	std::vector<char> frame(Geometry::Query::headerSize + size);
+	std::memcpy(frame.data(), &header, sizeof(header));
+	if (size > 0) {
+	    std::memcpy(frame.data() + sizeof(header), payload, size);
+	}
+	return frame;
+    }
+
+    // Sequential reader of a request payload; throws std::invalid_argument when it runs out.
+    class PayloadReader
+    {
+    public:
+	PayloadReader(const char* data, size_t size) : data(data), remaining(size) {}
+
+	template <typename T>
+	T read()
+	{
+	    T value;
+	    take(&value, sizeof(T));
+	    return value;
+	}
+
+	void take(void* target, size_t size)
+	{
+	    if (size > remaining) {
+		throw std::invalid_argument("truncated request");
+	    }
+	    std::memcpy(target, data, size);
+	    data += size;
+	    remaining -= size;
+	}
+
+	size_t left() const { return remaining; }
+
+	const char* position() const { return data; }
+
+    private:
+	const char* data;
+	size_t remaining;
+    };
+
+    Geometry::ModifiedGordonWixomSurface::HeightInterpolation interpolation(uint8_t flags)
+    {
+	return (flags & Geometry::Query::LoadFlags::LinearHeights) ? Geometry::ModifiedGordonWixomSurface::HeightInterpolation::Linear
+								   : Geometry::ModifiedGordonWixomSurface::HeightInterpolation::Cubic;
+    }
+
+    Geometry::SurfaceStore::SurfacePointer buildSurface(const Geometry::BoundaryLoops& loops, uint32_t directions, uint8_t flags)
+    {
+	if (loops.empty()) {
+	    throw std::invalid_argument("no boundary loops");
+	}
+	auto surface = std::make_shared<Geometry::ModifiedGordonWixomSurface>(loops[0], interpolation(flags));
+	for (size_t i = 1; i < loops.size(); i++) {
+	    surface->addInnerLoop(loops[i], interpolation(flags));
+	}
+	if (directions > 0) {
+	    surface->setDirectionCount(static_cast<int>(std::min<uint32_t>(directions, 1u << 20)));
+	}
+	return surface;
+    }
+}
+
+struct Geometry::QueryServer::Connection {
+    explicit Connection(int output) : output(output) {}
+
+    // Writes a whole frame; frames of concurrent evaluations do not interleave.
+    void write(const std::vector<char>& frame)
+    {
+	std::lock_guard<std::mutex> lock(writeMutex);
+	const char* data = frame.data();
+	size_t size = frame.size();
+	while (size > 0 && !broken) {
+	    ssize_t n = ::write(output, data, size);
+	    if (n < 0 && errno == EINTR) {
+		continue;
+	    }
+	    if (n <= 0) {
+		broken = true;
+		break;
+	    }
+	    data += n;
+	    size -= n;
+	}
+    }
+
+    int output;
+    std::mutex writeMutex;
+    std::atomic<bool> broken{false};	// The output failed (e.g. the client went away).
+    std::mutex pendingMutex;
+    std::condition_variable finished;
+    size_t pending = 0;			// Evaluations handed to the pool and not yet answered
+};
+
+void Geometry::SurfaceStore::load(uint32_t id, SurfacePointer surface)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    surfaces[id] = std::move(surface);
+}
+
+bool Geometry::SurfaceStore::unload(uint32_t id)
+{
+    SurfacePointer removed;	// Released after unlocking, in case this was the last reference.
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = surfaces.find(id);
+    if (it == surfaces.end()) {
+	return false;
+    }
+    removed = std::move(it->second);
+    surfaces.erase(it);
+    return true;
+}
+
+Geometry::SurfaceStore::SurfacePointer Geometry::SurfaceStore::find(uint32_t id) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = surfaces.find(id);
+    return (it == surfaces.end()) ? nullptr : it->second;
+}
+
+size_t Geometry::SurfaceStore::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return surfaces.size();
+}
+
+void Geometry::LatencyStats::add(uint64_t nanoseconds)
+{
+    // Values below 2 * subBuckets have a bucket each; above, bucket (exponent, top bits of the mantissa).
+    size_t bucket = nanoseconds;
+    if (nanoseconds >= 2 * subBuckets) {
+	int exponent = std::bit_width(nanoseconds) - 1;
+	size_t mantissa = (nanoseconds >> (exponent - 3)) & (subBuckets - 1);
+	bucket = (exponent - 2) * subBuckets + mantissa;
+    }
+    buckets[std::min(bucket, buckets.size() - 1)]++;
+    total++;
+    sum += nanoseconds;
+    max = std::max(max, nanoseconds);
+}
+
+uint64_t Geometry::LatencyStats::count() const
+{
+    return total;
+}
+
+double Geometry::LatencyStats::meanMicroseconds() const
+{
+    return (total == 0) ? 0.0 : sum / 1.0e3 / total;
+}
+
+double Geometry::LatencyStats::maxMicroseconds() const
+{
+    return max / 1.0e3;
+}
+
+double Geometry::LatencyStats::percentileMicroseconds(double fraction) const
+{
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * total));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); bucket++) {
+	seen += buckets[bucket];
+	if (seen >= std::max<uint64_t>(rank, 1)) {
+	    if (bucket < 2 * subBuckets) {
+		return std::min(max, static_cast<uint64_t>(bucket)) / 1.0e3;
+	    }
+	    // The largest value of the bucket, i.e. one below the smallest of the next:
+	    size_t exponent = bucket / subBuckets + 2;
+	    uint64_t mantissa = bucket % subBuckets + subBuckets + 1;
+	    return std::min(max, (mantissa << (exponent - 3)) - 1) / 1.0e3;
+	}
+    }
+    return maxMicroseconds();
+}
+
+Geometry::QueryServer::QueryServer(SurfaceStore& store)
+    : store(store), wakeup(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+}
+
+Geometry::QueryServer::~QueryServer()
+{
+    close(wakeup);
+}
+
+Geometry::SurfaceStore& Geometry::QueryServer::surfaces()
+{
+    return store;
+}
+
+std::vector<char> Geometry::QueryServer::handle(const std::vector<char>& request)
+{
+    Clock::time_point start = Clock::now();
+    uint32_t id = 0;
+    if (request.size() >= Query::headerSize) {
+	std::memcpy(&id, request.data() + offsetof(Header, value), sizeof(id));
+    }
+    return process(request, store.find(id), start);
+}
+
+std::vector<char> Geometry::QueryServer::process(const std::vector<char>& request, const SurfaceStore::SurfacePointer& surface,
+						  Clock::time_point start)
+{
+    Header header{};
+    std::memcpy(&header, request.data(), std::min(request.size(), sizeof(header)));
+    const Query::Op op = static_cast<Query::Op>(header.code);
+    std::vector<char> response;
+    try {
+	if (request.size() < Query::headerSize) {
+	    throw std::invalid_argument("truncated request");
+	}
+	PayloadReader payload(request.data() + Query::headerSize, request.size() - Query::headerSize);
+	switch (op) {
+	case Query::Op::Load: {
+	    uint32_t directions = payload.read<uint32_t>();
+	    uint32_t loopCount = payload.read<uint32_t>();
+	    if (loopCount == 0 || loopCount > payload.left() / sizeof(uint32_t)) {
+		throw std::invalid_argument("invalid loop count");
+	    }
+	    std::vector<uint32_t> counts(loopCount);
+	    payload.take(counts.data(), loopCount * sizeof(uint32_t));
+	    SampledBoundary loops(loopCount);
+	    for (uint32_t i = 0; i < loopCount; i++) {
+		if (counts[i] > payload.left() / sizeof(Point3D)) {
+		    throw std::invalid_argument("truncated request");
+		}
+		loops[i].resize(counts[i]);
+		for (Point3D& p : loops[i]) {
+		    double xyh[3];
+		    payload.take(xyh, sizeof(xyh));
+		    p = Point3D(xyh[0], xyh[1], xyh[2]);
+		}
+	    }
+	    store.load(header.value, buildSurface(BoundaryLoops(std::move(loops)), directions, header.flags));
+	    response = responseFrame(Query::Status::Ok, header.tag, start, nullptr, 0);
+	    break;
+	}
+	case Query::Op::LoadFile: {
+	    uint32_t directions = payload.read<uint32_t>();
+	    std::string filename(payload.position(), payload.left());
+	    BoundaryLoops loops = readBoundary(filename);
+	    if (loops.empty()) {
+		throw std::invalid_argument("cannot read " + filename);
+	    }
+	    store.load(header.value, buildSurface(loops, directions, header.flags));
+	    response = responseFrame(Query::Status::Ok, header.tag, start, nullptr, 0);
+	    break;
+	}
+	case Query::Op::Eval: {
+	    if (!surface) {
+		throw std::invalid_argument("unknown surface " + std::to_string(header.value));
+	    }
+	    if (payload.left() % (2 * sizeof(double)) != 0) {
+		throw std::invalid_argument("the points are not pairs of doubles");
+	    }
+	    const size_t n = payload.left() / (2 * sizeof(double));
+	    const bool gradient = header.flags & Query::EvalFlags::Gradient;
+	    const size_t stride = gradient ? 3 : 1;
+	    std::vector<double> points(2 * n);
+	    payload.take(points.data(), points.size() * sizeof(double));
+	    std::vector<double> results(stride * n);
+	    parallelFor(n, [&](size_t i) {
+		Point2D p(points[2 * i], points[2 * i + 1]);
+		if (gradient) {
+		    auto [u, g] = surface->evalWithGradient(p);
+		    results[3 * i] = u;
+		    results[3 * i + 1] = g[0];
+		    results[3 * i + 2] = g[1];
+		}
+		else {
+		    results[i] = surface->eval(p);
+		}
+	    }, 16);
+	    response = responseFrame(Query::Status::Ok, header.tag, start, results.data(), results.size() * sizeof(double));
+	    break;
+	}
+	case Query::Op::Unload:
+	    if (!store.unload(header.value)) {
+		throw std::invalid_argument("unknown surface " + std::to_string(header.value));
+	    }
+	    response = responseFrame(Query::Status::Ok, header.tag, start, nullptr, 0);
+	    break;
+	case Query::Op::Stats: {
+	    std::string text = report();
+	    response = responseFrame(Query::Status::Ok, header.tag, start, text.data(), text.size());
+	    break;
+	}
+	default:
+	    throw std::invalid_argument("unknown request " + std::to_string(header.code));
+	}
+    }
+    catch (const std::exception& e) {
+	response = responseFrame(Query::Status::Error, header.tag, start, e.what(), std::strlen(e.what()));
+    }
+    record(op, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    return response;
+}
+
+void Geometry::QueryServer::record(Query::Op op, uint64_t nanoseconds)
+{
+    size_t index = static_cast<size_t>(op);
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats[index < stats.size() - 1 ? index : 0].add(nanoseconds);
+}
+
+std::string Geometry::QueryServer::report() const
+{
+    std::string text;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-10s %10s %10s %10s %10s %10s\n", "request", "count", "mean [us]", "p50 [us]", "p99 [us]",
+		  "max [us]");
+    text += line;
+    std::lock_guard<std::mutex> lock(statsMutex);
+    for (size_t i = 0; i < stats.size(); i++) {
+	const LatencyStats& s = stats[i];
+	if (s.count() == 0) {
+	    continue;
+	}
+	std::snprintf(line, sizeof(line), "%-10s %10llu %10.1f %10.1f %10.1f %10.1f\n", opNames[i],
+		      static_cast<unsigned long long>(s.count()), s.meanMicroseconds(), s.percentileMicroseconds(0.5),
+		      s.percentileMicroseconds(0.99), s.maxMicroseconds());
+	text += line;
+    }
+    return text;
+}
+
+void Geometry::QueryServer::serve(int input, int output)
+{
+    auto connection = std::make_shared<Connection>(output);
+    std::vector<char> frame;
+    while (!connection->broken && readFrame(input, wakeup, frame)) {
+	Clock::time_point start = Clock::now();
+	Header header;
+	std::memcpy(&header, frame.data(), sizeof(header));
+	if (static_cast<Query::Op>(header.code) != Query::Op::Eval) {
+	    connection->write(process(frame, nullptr, start));
+	    continue;
+	}
+
+	// The surface is looked up now, so an evaluation sees the loads and unloads before it and not those after it:
+	auto request = std::make_shared<const std::vector<char>>(std::move(frame));
+	auto surface = store.find(header.value);
+	{
+	    std::lock_guard<std::mutex> lock(connection->pendingMutex);
+	    connection->pending++;
+	}
+	auto task = [this, connection, request, surface, start]() {
+	    connection->write(process(*request, surface, start));
+	    std::lock_guard<std::mutex> lock(connection->pendingMutex);
+	    if (--connection->pending == 0) {
+		connection->finished.notify_all();
+	    }
+	};
+	if (ThreadPool::shared().offer(task, 1) == 0) {
+	    task();
+	}
+	frame = std::vector<char>();
+    }
+    std::unique_lock<std::mutex> lock(connection->pendingMutex);
+    connection->finished.wait(lock, [&connection]() { return connection->pending == 0; });
+}
+
+void Geometry::QueryServer::serve(ShmQueue& queue)
+{
+    while (!stopping) {
+	if (!queue.next(100)) {
+	    continue;
+	}
+	Clock::time_point start = Clock::now();
+	SurfaceStore::SurfacePointer surface = store.find(queue.batchSurface());
+	if (!surface) {
+	    queue.fail("unknown surface " + std::to_string(queue.batchSurface()));
+	    continue;
+	}
+	std::span<const Point2D> points = queue.batchPoints();
+	std::span<double> results = queue.batchResults();
+	if (queue.batchGradient()) {
+	    parallelFor(points.size(), [&](size_t i) {
+		auto [u, g] = surface->evalWithGradient(points[i]);
+		results[3 * i] = u;
+		results[3 * i + 1] = g[0];
+		results[3 * i + 2] = g[1];
+	    }, 16);
+	}
+	else {
+	    parallelFor(points.size(), [&](size_t i) { results[i] = surface->eval(points[i]); }, 16);
+	}
+	// Measured before the client is woken, which may take over this core right away:
+	uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	queue.complete();
+	std::lock_guard<std::mutex> lock(statsMutex);
+	stats.back().add(nanoseconds);
+    }
+}
+
+bool Geometry::QueryServer::listen(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+	return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+	return false;
+    }
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 64) != 0) {
+	close(fd);
+	return false;
+    }
+
+    // Connections run on their own threads, which all end on stop() as well.
+    std::mutex mutex;
+    std::condition_variable closed;
+    size_t clients = 0;
+    while (waitForInput(fd, wakeup)) {
+	int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (client < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED) {
+		continue;
+	    }
+	    break;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	clients++;
+	std::thread([this, client, &mutex, &closed, &clients]() {
+	    serve(client, client);
+	    close(client);
+	    std::lock_guard<std::mutex> lock(mutex);
+	    clients--;
+	    closed.notify_all();
+	}).detach();
+    }
+    close(fd);
+    unlink(path.c_str());
+
+    std::unique_lock<std::mutex> lock(mutex);
+    closed.wait(lock, [&clients]() { return clients == 0; });
+    return true;
+}
+
+void Geometry::QueryServer::stop()
+{
+    stopping = true;
+    uint64_t one = 1;
+    ssize_t written = write(wakeup, &one, sizeof(one));
+    (void)written;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "modifiedgordonwixomsurface.h"
+#include "shmqueue.h"
+
+namespace Geometry {
+
+  /*
+   * Surfaces kept resident by id, for any number of threads: lookups hand out shared ownership, so a surface that is
+   * replaced or unloaded stays alive until the evaluations already using it are done.
+  */
+  class SurfaceStore
+  {
+  public:
+    using SurfacePointer = std::shared_ptr<const ModifiedGordonWixomSurface>;
+
+    /*
+     * Adds the surface, replacing any surface with the same id.
+    */
+    void load(uint32_t id, SurfacePointer surface);
+
+    /*
+     * Returns false if there was no such surface.
+    */
+    bool unload(uint32_t id);
+
+    /*
+     * Null if there is no such surface.
+    */
+    SurfacePointer find(uint32_t id) const;
+
+    size_t size() const;
+
+  private:
+    mutable std::shared_mutex mutex;
+    std::unordered_map<uint32_t, SurfacePointer> surfaces;
+  };
+
+  /*
+   * Request latencies in a log-linear histogram (8 buckets per power of two of nanoseconds, i.e. within 12.5%),
+   * so a long-running server records them in constant memory.
+  */
+  class LatencyStats
+  {
+  public:
+    void add(uint64_t nanoseconds);
+
+    uint64_t count() const;
+
+    double meanMicroseconds() const;
+
+    double maxMicroseconds() const;
+
+    /*
+     * Upper end of the bucket holding the given fraction (in [0, 1]) of the requests.
+    */
+    double percentileMicroseconds(double fraction) const;
+
+  private:
+    static constexpr size_t subBuckets = 8;
+
+    std::array<uint64_t, 64 * subBuckets> buckets{};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+  };
+
+  /*
+   * Binary request / response framing of QueryServer, in native byte order. Every frame starts with a 16 byte header
+   * whose first field is the size of the rest of the frame (header and payload), so frames can be read in two steps:
+   *   request:  uint32 size, uint8 op, uint8 flags, uint16 0, uint32 tag, uint32 surface id, payload
+   *   response: uint32 size, uint8 status, uint8 0, uint16 0, uint32 tag, uint32 microseconds, payload
+   * The tag of a request is returned in its response; responses to evaluations can arrive out of order.
+   * The microseconds are the server-side latency, from the request being read to its response being ready.
+   * A failed request gets status Error and its message as payload.
+  */
+  namespace Query {
+
+    enum class Op : uint8_t {
+	Load = 1,	// Payload: uint32 direction count (0: default), uint32 loop count L, uint32 sample count of each
+			// of the L loops, then the samples as doubles x, y, height (outer loop first).
+			// LoadFlags::LinearHeights interpolates the heights linearly instead of cubically.
+	LoadFile = 2,	// Payload: uint32 direction count, then the name of a boundary file (see readBoundary). Flags as Load.
+	Eval = 3,	// Payload: points as doubles x, y. Response: a double height per point, or with EvalFlags::Gradient
+			// height, gradient x, gradient y per point.
+	Unload = 4,	// No payload.
+	Stats = 5	// No payload (surface id ignored). Response: the latency report as text.
+    };
+
+    // Bits of the flags field, which each op interprets on its own:
+    namespace LoadFlags {
+	constexpr uint8_t LinearHeights = 1;	// Load, LoadFile
+    }
+
+    namespace EvalFlags {
+	constexpr uint8_t Gradient = 1;		// Eval
+    }
+
+    enum class Status : uint8_t { Ok = 0, Error = 1 };
+
+    constexpr size_t headerSize = 16;
+
+    constexpr uint32_t maxFrameSize = 1u << 30;
+  }
+
+  /*
+   * Evaluation server over a SurfaceStore, talking the Query framing over byte streams (pipes, sockets).
+   * Requests of a stream are read in order: loads and unloads are handled right away (so later requests see them),
+   * evaluations are handed to an idle worker of the shared ThreadPool (or evaluated by the reading thread if there is
+   * none), and large batches are spread over the idle workers by parallelFor.
+  */
+  class QueryServer
+  {
+  public:
+    explicit QueryServer(SurfaceStore& store);
+
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    /*
+     * Serves one stream until the input ends or breaks; returns once all its responses are written.
+    */
+    void serve(int input, int output);
+
+    /*
+     * Evaluates the batches of a shared memory queue in place until stop() is called (see ShmQueue);
+     * batches are spread over the idle workers of the shared ThreadPool like evaluation requests.
+    */
+    void serve(ShmQueue& queue);
+
+    /*
+     * Accepts connections on a Unix domain socket at path (replacing a stale socket file), each served by its own
+     * thread, until stop() is called or accepting fails; returns false if the socket cannot be set up.
+    */
+    bool listen(const std::string& path);
+
+    /*
+     * Makes listen() and serve() return after answering the requests already read; async-signal-safe.
+    */
+    void stop();
+
+    /*
+     * Count, mean, median, 99th percentile and maximum latency of each kind of request.
+    */
+    std::string report() const;
+
+    /*
+     * Handles a complete request frame and returns the response frame; thread-safe.
+    */
+    std::vector<char> handle(const std::vector<char>& request);
+
+    SurfaceStore& surfaces();
+
+  private:
+    struct Connection;
+
+    /*
+     * handle() for a request read at start; an evaluation uses the given surface, looked up when the request was read.
+    */
+    std::vector<char> process(const std::vector<char>& request, const SurfaceStore::SurfacePointer& surface,
+			      std::chrono::steady_clock::time_point start);
+
+    void record(Query::Op op, uint64_t nanoseconds);
+
+    SurfaceStore& store;
+    mutable std::mutex statsMutex;
+    std::array<LatencyStats, 7> stats;	// By op, then the batches of shared memory queues
+    int wakeup;			// eventfd that becomes readable on stop(), polled together with every input
+    std::atomic<bool> stopping{false};
+  };
+}
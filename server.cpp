@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "parallel.h"
+#include "queryserver.h"
+
+namespace {
+
+    Geometry::QueryServer* server = nullptr;
+
+    void printUsage(const char* program)
+    {
+	std::fprintf(stderr,
+		     "Usage: %s [--threads N] [--socket PATH] [--shm NAME]... [--shm-slots N] [--shm-points N]\n"
+		     "  --threads N      threads evaluating requests, including the one reading them (default: hardware threads)\n"
+		     "  --socket PATH    accept connections on a Unix domain socket instead of serving stdin / stdout\n"
+		     "  --shm NAME       also evaluate the batches of a shared memory queue (shmqueue.h) created as NAME\n"
+		     "  --shm-slots N    batches in flight per queue, rounded up to a power of two (default: 8)\n"
+		     "  --shm-points N   points per batch (default: 16384)\n"
+		     "\n"
+		     "Keeps surfaces resident by id and answers load, eval and unload requests in the binary framing of\n"
+		     "queryserver.h. Ends at the end of the input (or on SIGINT / SIGTERM) and prints the request latencies.\n",
+		     program);
+    }
+
+    void stopServer(int)
+    {
+	server->stop();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* socketPath = nullptr;
+    std::vector<std::string> queueNames;
+    uint32_t queueSlots = 8;
+    uint32_t queuePoints = 16384;
+    for (int i = 1; i < argc; i++) {
+	if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+	    Geometry::ThreadPool::setThreadCount(std::max(1, std::atoi(argv[++i])));
+	}
+	else if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+	    socketPath = argv[++i];
+	}
+	else if (std::strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+	    queueNames.push_back(argv[++i]);
+	}
+	else if (std::strcmp(argv[i], "--shm-slots") == 0 && i + 1 < argc) {
+	    queueSlots = std::max(1, std::atoi(argv[++i]));
+	}
+	else if (std::strcmp(argv[i], "--shm-points") == 0 && i + 1 < argc) {
+	    queuePoints = std::max(1, std::atoi(argv[++i]));
+	}
+	else {
+	    printUsage(argv[0]);
+	    return 1;
+	}
+    }
+
+    Geometry::SurfaceStore store;
+    Geometry::QueryServer queryServer(store);
+    server = &queryServer;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+    std::signal(SIGPIPE, SIG_IGN);	// Clients that go away show up as failed writes.
+
+    std::vector<std::unique_ptr<Geometry::ShmQueue>> queues;
+    std::vector<std::thread> queueThreads;
+    try {
+	for (const std::string& name : queueNames) {
+	    queues.push_back(Geometry::ShmQueue::create(name, queueSlots, queuePoints));
+	}
+    }
+    catch (const std::runtime_error& e) {
+	std::fprintf(stderr, "%s\n", e.what());
+	return 1;
+    }
+    for (auto& queue : queues) {
+	queueThreads.emplace_back([&queryServer, &queue]() { queryServer.serve(*queue); });
+    }
+
+    bool listening = true;
+    if (socketPath != nullptr) {
+	listening = queryServer.listen(socketPath);
+	if (!listening) {
+	    std::fprintf(stderr, "Cannot listen on %s\n", socketPath);
+	}
+    }
+    else {
+	// Responses go to the original stdout; anything else printed there (diagnostics of eval) goes to stderr instead.
+	int output = dup(STDOUT_FILENO);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+	queryServer.serve(STDIN_FILENO, output);
+	close(output);
+    }
+    queryServer.stop();
+    for (std::thread& thread : queueThreads) {
+	thread.join();
+    }
+    std::fprintf(stderr, "%s", queryServer.report().c_str());
+    return listening ? 0 : 1;
+}
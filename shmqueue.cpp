@@ -0,0 +1,367 @@
+#include "shmqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+    constexpr uint32_t magic = 0x51534850;	// "PHSQ"
+    constexpr uint32_t version = 1;
+
+    enum SlotState : uint32_t {
+	Free = 0,
+	Submitted = 1,
+	SubmittedWaiting = 2,	// Submitted, and the client sleeps on the state
+	Done = 3,
+	Failed = 4
+    };
+
+    constexpr int clientTimeout = 100;	// Milliseconds between checks whether the server closed the queue
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+    static_assert(std::is_trivially_copyable_v<Geometry::Point2D> && sizeof(Geometry::Point2D) == 2 * sizeof(double));
+
+    // Sleeps while word == expected, for at most timeoutMilliseconds; the word may be shared between processes.
+    void futexWait(std::atomic<uint32_t>& word, uint32_t expected, int timeoutMilliseconds)
+    {
+	timespec timeout = { timeoutMilliseconds / 1000, (timeoutMilliseconds % 1000) * 1000000L };
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    void futexWake(std::atomic<uint32_t>& word)
+    {
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    // Spinning only pays off when the other side can run on another core meanwhile.
+    int spinLimit()
+    {
+	static const int limit = (std::thread::hardware_concurrency() > 1) ? 4000 : 0;
+	return limit;
+    }
+
+    inline void cpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+    }
+
+    // The slot count divides 2^32, so that tickets keep their slots when the 32 bit counters wrap around.
+    bool validSize(uint32_t slotCount, uint32_t slotCapacity)
+    {
+	return std::has_single_bit(slotCount) && slotCapacity != 0 && size_t(slotCount) * slotCapacity <= (size_t(1) << 32);
+    }
+
+    size_t alignUp(size_t n)
+    {
+	return (n + 63) & ~size_t(63);
+    }
+
+    // Waits until the slot is not submitted any more and returns its state; throws if the queue is closed meanwhile.
+    uint32_t waitForSlot(std::atomic<uint32_t>& state, const std::atomic<uint32_t>& closed)
+    {
+	uint32_t s = state.load(std::memory_order_acquire);
+	for (int i = 0; i < spinLimit() && (s == Submitted || s == SubmittedWaiting); i++) {
+	    cpuRelax();
+	    s = state.load(std::memory_order_acquire);
+	}
+	while (s == Submitted || s == SubmittedWaiting) {
+	    if (closed.load()) {
+		throw std::runtime_error("the server closed the evaluation queue");
+	    }
+	    // Announce the sleep in the state itself, so that the server's exchange sees it:
+	    if (s == Submitted && !state.compare_exchange_strong(s, SubmittedWaiting, std::memory_order_acquire)) {
+		continue;
+	    }
+	    futexWait(state, SubmittedWaiting, clientTimeout);
+	    s = state.load(std::memory_order_acquire);
+	}
+	return s;
+    }
+
+    std::runtime_error systemError(const std::string& what, const std::string& name)
+    {
+	return std::runtime_error(what + " " + name + ": " + std::strerror(errno));
+    }
+}
+
+/*
+ * Start of the mapping; the counters written by the two sides are on separate cache lines.
+ * Either side can write all of it, so the sizes are only read once, validated, by create() and attach().
+*/
+struct Geometry::ShmQueue::Control {
+    std::atomic<uint32_t> magic;	// Set last by the creator
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotCapacity;
+    std::atomic<uint32_t> closed;
+    alignas(64) std::atomic<uint32_t> head;	// Batches submitted (client)
+    std::atomic<uint32_t> serverSleeping;	// The server sleeps on head
+    alignas(64) std::atomic<uint32_t> tail;	// Batches finished (server)
+};
+
+struct Geometry::ShmQueue::Slot {
+    alignas(64) std::atomic<uint32_t> state;	// SlotState
+    uint32_t surface;
+    uint32_t count;
+    uint32_t gradient;
+    char message[112];				// Of a failed batch
+};
+
+size_t Geometry::ShmQueue::layout(uint32_t slotCount, uint32_t slotCapacity, size_t& slotsOffset, size_t& pointsOffset,
+				  size_t& resultsOffset)
+{
+    const size_t points = size_t(slotCount) * slotCapacity;
+    slotsOffset = alignUp(sizeof(Control));
+    pointsOffset = alignUp(slotsOffset + sizeof(Slot) * slotCount);
+    resultsOffset = alignUp(pointsOffset + sizeof(Point2D) * points);
+    return resultsOffset + 3 * sizeof(double) * points;
+}
+
+std::unique_ptr<Geometry::ShmQueue> Geometry::ShmQueue::create(const std::string& name, uint32_t slotCount, uint32_t slotCapacity)
+{
+    if (slotCount > (1u << 31)) {
+	throw std::runtime_error("invalid shared memory queue size");
+    }
+    slotCount = std::bit_ceil(std::max(slotCount, 1u));
+    if (!validSize(slotCount, slotCapacity)) {
+	throw std::runtime_error("invalid shared memory queue size");
+    }
+    size_t slotsOffset, pointsOffset, resultsOffset;
+    size_t size = layout(slotCount, slotCapacity, slotsOffset, pointsOffset, resultsOffset);
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+	throw systemError("cannot create", name);
+    }
+    if (ftruncate(fd, size) != 0) {
+	::close(fd);
+	shm_unlink(name.c_str());
+	throw systemError("cannot size", name);
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+	shm_unlink(name.c_str());
+	throw systemError("cannot map", name);
+    }
+
+    // The object starts out zeroed: every slot free, head = tail = 0.
+    char* base = static_cast<char*>(mapping);
+    Control* control = new (base) Control{};
+    control->version = version;
+    control->slotCount = slotCount;
+    control->slotCapacity = slotCapacity;
+    for (uint32_t i = 0; i < slotCount; i++) {
+	new (base + slotsOffset + i * sizeof(Slot)) Slot{};
+    }
+    control->magic.store(magic, std::memory_order_release);
+    return std::unique_ptr<ShmQueue>(new ShmQueue(name, mapping, size, true, slotCount, slotCapacity));
+}
+
+std::unique_ptr<Geometry::ShmQueue> Geometry::ShmQueue::attach(const std::string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+	throw systemError("cannot open", name);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Control)) {
+	::close(fd);
+	throw std::runtime_error(name + " is not an evaluation queue");
+    }
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+	throw systemError("cannot map", name);
+    }
+    const Control* control = static_cast<const Control*>(mapping);
+    bool valid = control->magic.load(std::memory_order_acquire) == magic && control->version == version;
+    const uint32_t slotCount = control->slotCount, slotCapacity = control->slotCapacity;
+    size_t slotsOffset, pointsOffset, resultsOffset;
+    if (!valid || !validSize(slotCount, slotCapacity) ||
+	layout(slotCount, slotCapacity, slotsOffset, pointsOffset, resultsOffset) != size_t(st.st_size)) {
+	munmap(mapping, st.st_size);
+	throw std::runtime_error(name + " is not an evaluation queue");
+    }
+    return std::unique_ptr<ShmQueue>(new ShmQueue(name, mapping, st.st_size, false, slotCount, slotCapacity));
+}
+
+Geometry::ShmQueue::ShmQueue(const std::string& name, void* mapping, size_t size, bool owner, uint32_t ringSize,
+			     uint32_t capacity)
+    : name(name), mapping(mapping), size(size), owner(owner), ringSize(ringSize), capacity(capacity)
+{
+    char* base = static_cast<char*>(mapping);
+    control = reinterpret_cast<Control*>(base);
+    size_t slotsOffset, pointsOffset, resultsOffset;
+    layout(ringSize, capacity, slotsOffset, pointsOffset, resultsOffset);
+    slots = reinterpret_cast<Slot*>(base + slotsOffset);
+    pointData = reinterpret_cast<Point2D*>(base + pointsOffset);
+    resultData = reinterpret_cast<double*>(base + resultsOffset);
+    reserved = control->head.load();
+}
+
+Geometry::ShmQueue::~ShmQueue()
+{
+    if (owner) {
+	close();
+	shm_unlink(name.c_str());
+    }
+    munmap(mapping, size);
+}
+
+uint32_t Geometry::ShmQueue::slotCount() const
+{
+    return ringSize;
+}
+
+uint32_t Geometry::ShmQueue::slotCapacity() const
+{
+    return capacity;
+}
+
+Geometry::ShmQueue::Slot& Geometry::ShmQueue::slot(uint32_t ticket) const
+{
+    return slots[ticket % ringSize];
+}
+
+uint32_t Geometry::ShmQueue::reserve()
+{
+    uint32_t ticket = reserved;
+    waitForSlot(slot(ticket).state, control->closed);
+    reserved++;
+    return ticket;
+}
+
+std::span<Geometry::Point2D> Geometry::ShmQueue::points(uint32_t ticket)
+{
+    return std::span<Point2D>(pointData + size_t(ticket % ringSize) * capacity, capacity);
+}
+
+void Geometry::ShmQueue::submit(uint32_t ticket, uint32_t surface, uint32_t count, bool gradient)
+{
+    const uint32_t head = control->head.load(std::memory_order_relaxed);
+    if (ticket != head || reserved - ticket == 0) {
+	throw std::logic_error("batches have to be reserved and submitted in order");
+    }
+    if (count > capacity) {
+	throw std::invalid_argument("too many points for a batch");
+    }
+    Slot& s = slot(ticket);
+    s.surface = surface;
+    s.count = count;
+    s.gradient = gradient ? 1 : 0;
+    s.state.store(Submitted, std::memory_order_relaxed);
+    // Publishes the slot and its points; seq_cst against the server announcing its sleep (see next()).
+    control->head.store(head + 1, std::memory_order_seq_cst);
+    if (control->serverSleeping.load(std::memory_order_seq_cst)) {
+	futexWake(control->head);
+    }
+}
+
+std::span<const double> Geometry::ShmQueue::wait(uint32_t ticket)
+{
+    const uint32_t submitted = control->head.load(std::memory_order_relaxed) - ticket;
+    if (submitted == 0 || submitted > ringSize) {
+	throw std::logic_error("waiting for a batch that is not submitted or already overwritten");
+    }
+    Slot& s = slot(ticket);
+    if (waitForSlot(s.state, control->closed) == Failed) {
+	throw std::runtime_error(std::string(s.message, strnlen(s.message, sizeof(s.message))));
+    }
+    size_t count = std::min(s.count, capacity);
+    return std::span<const double>(resultData + 3 * size_t(ticket % ringSize) * capacity, s.gradient ? 3 * count : count);
+}
+
+bool Geometry::ShmQueue::next(int timeoutMilliseconds)
+{
+    const uint32_t tail = control->tail.load(std::memory_order_relaxed);
+    if (control->head.load(std::memory_order_acquire) != tail) {
+	return true;
+    }
+    for (int i = 0; i < spinLimit(); i++) {
+	cpuRelax();
+	if (control->head.load(std::memory_order_acquire) != tail) {
+	    return true;
+	}
+    }
+    // Either the client sees the announcement after its store to head, or this sees its store:
+    control->serverSleeping.store(1, std::memory_order_seq_cst);
+    if (control->head.load(std::memory_order_seq_cst) == tail) {
+	futexWait(control->head, tail, timeoutMilliseconds);
+    }
+    control->serverSleeping.store(0, std::memory_order_relaxed);
+    return control->head.load(std::memory_order_acquire) != tail;
+}
+
+uint32_t Geometry::ShmQueue::batchSurface() const
+{
+    return slot(control->tail.load(std::memory_order_relaxed)).surface;
+}
+
+bool Geometry::ShmQueue::batchGradient() const
+{
+    return slot(control->tail.load(std::memory_order_relaxed)).gradient != 0;
+}
+
+std::span<const Geometry::Point2D> Geometry::ShmQueue::batchPoints() const
+{
+    const uint32_t tail = control->tail.load(std::memory_order_relaxed);
+    return std::span<const Point2D>(pointData + size_t(tail % ringSize) * capacity, std::min(slot(tail).count, capacity));
+}
+
+std::span<double> Geometry::ShmQueue::batchResults()
+{
+    const uint32_t tail = control->tail.load(std::memory_order_relaxed);
+    const Slot& s = slot(tail);
+    size_t count = std::min(s.count, capacity);
+    return std::span<double>(resultData + 3 * size_t(tail % ringSize) * capacity, s.gradient ? 3 * count : count);
+}
+
+void Geometry::ShmQueue::complete()
+{
+    finish(Done);
+}
+
+void Geometry::ShmQueue::fail(const std::string& message)
+{
+    Slot& s = slot(control->tail.load(std::memory_order_relaxed));
+    size_t length = std::min(message.size(), sizeof(s.message) - 1);
+    std::memcpy(s.message, message.data(), length);
+    s.message[length] = '\0';
+    finish(Failed);
+}
+
+void Geometry::ShmQueue::finish(uint32_t state)
+{
+    const uint32_t tail = control->tail.load(std::memory_order_relaxed);
+    Slot& s = slot(tail);
+    control->tail.store(tail + 1, std::memory_order_release);
+    if (s.state.exchange(state, std::memory_order_acq_rel) == SubmittedWaiting) {
+	futexWake(s.state);
+    }
+}
+
+void Geometry::ShmQueue::close()
+{
+    control->closed.store(1);
+    for (uint32_t i = 0; i < ringSize; i++) {
+	futexWake(slots[i].state);
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "geometry.hh"
+
+namespace Geometry {
+
+  /*
+   * Evaluation queue in POSIX shared memory between one client process and the query server, so that points and heights
+   * are never serialized or copied: the client writes the points of a batch straight into a slot of the mapping, the
+   * server evaluates them where they are and writes the results into the slot's paired result buffer.
+   *
+   * Slots form a ring with a head (batches submitted, advanced by the client) and a tail (batches taken, advanced by the
+   * server); both only ever grow (modulo 2^32, which the power of two slot count divides), so neither side takes a lock. Each side spins briefly and then sleeps on a futex in the
+   * mapping (the server on the head, the client on the state of its slot), and the other side only makes the wake-up call
+   * when the sleeper has announced itself.
+   *
+   * One thread of one client process drives a queue; use a queue per client thread for more.
+   * Surfaces are loaded and unloaded through the QueryServer protocol and evaluated here by id.
+  */
+  class ShmQueue
+  {
+  public:
+    /*
+     * Creates the shared memory object (e.g. "/surfaces", see shm_open) with slotCount batches (rounded up to a power
+     * of two) of up to slotCapacity points, replacing a stale one of the same name; removed again when the queue is
+     * destroyed. Throws std::runtime_error.
+    */
+    static std::unique_ptr<ShmQueue> create(const std::string& name, uint32_t slotCount, uint32_t slotCapacity);
+
+    /*
+     * Maps the queue created by the server. Throws std::runtime_error if there is none.
+    */
+    static std::unique_ptr<ShmQueue> attach(const std::string& name);
+
+    ~ShmQueue();
+
+    ShmQueue(const ShmQueue&) = delete;
+
+    ShmQueue& operator=(const ShmQueue&) = delete;
+
+    uint32_t slotCount() const;
+
+    uint32_t slotCapacity() const;
+
+    // Client side
+
+    /*
+     * Waits until the next slot is no longer being evaluated and returns its ticket. The results of the batch that
+     * used the slot before (ticket - slotCount) are overwritten from here on.
+    */
+    uint32_t reserve();
+
+    /*
+     * Where the points of the reserved batch go (slotCapacity of them).
+    */
+    std::span<Point2D> points(uint32_t ticket);
+
+    /*
+     * Hands the first count points of the batch to the server, to be evaluated on the given surface (with gradients:
+     * height, gradient x, gradient y per point). Batches have to be submitted in the order they were reserved.
+    */
+    void submit(uint32_t ticket, uint32_t surface, uint32_t count, bool gradient = false);
+
+    /*
+     * Waits for the batch and returns its results, which stay valid until the slot is reserved again.
+     * Throws std::runtime_error with the server's message if the batch failed, or if the server closed the queue.
+    */
+    std::span<const double> wait(uint32_t ticket);
+
+    // Server side
+
+    /*
+     * Waits for the next submitted batch; returns false if none arrives within the timeout (so the caller can check
+     * whether to stop). The batch is described by the accessors below until complete() or fail().
+    */
+    bool next(int timeoutMilliseconds);
+
+    uint32_t batchSurface() const;
+
+    bool batchGradient() const;
+
+    std::span<const Point2D> batchPoints() const;
+
+    /*
+     * Where the results of the batch go (count or 3 * count of them).
+    */
+    std::span<double> batchResults();
+
+    void complete();
+
+    void fail(const std::string& message);
+
+    /*
+     * Makes waiting clients fail; called by the creator's destructor.
+    */
+    void close();
+
+  private:
+    struct Control;
+    struct Slot;
+
+    ShmQueue(const std::string& name, void* mapping, size_t size, bool owner, uint32_t ringSize, uint32_t capacity);
+
+    /*
+     * Size of the mapping and the offsets of the slots, the points and the results in it.
+    */
+    static size_t layout(uint32_t slotCount, uint32_t slotCapacity, size_t& slotsOffset, size_t& pointsOffset, size_t& resultsOffset);
+
+    Slot& slot(uint32_t ticket) const;
+
+    /*
+     * Finishes the batch at the tail with the given state and wakes the client if it sleeps on it.
+    */
+    void finish(uint32_t state);
+
+    std::string name;
+    void* mapping;
+    size_t size;
+    bool owner;			// Created (and unlinks) the shared memory object
+    uint32_t ringSize;		// Slot count and capacity as validated when mapping, never read from the mapping again
+    uint32_t capacity;
+    Control* control;
+    Slot* slots;
+    Point2D* pointData;
+    double* resultData;
+    uint32_t reserved = 0;	// Client: tickets handed out
+  };
+}
@@ -0,0 +1,168 @@
+#include "sizingfield.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+    thread_local const Geometry::SizingField* currentField = nullptr;
+
+    bool isInside(const std::vector<Geometry::Point2D>& polygon, const Geometry::Point2D& p)
+    {
+	bool inside = false;
+	for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+	    if ((polygon[i][1] > p[1]) != (polygon[j][1] > p[1]) &&
+		p[0] < (polygon[j][0] - polygon[i][0]) * (p[1] - polygon[i][1]) / (polygon[j][1] - polygon[i][1]) + polygon[i][0]) {
+		inside = !inside;
+	    }
+	}
+	return inside;
+    }
+
+    bool isOnBoundary(const std::vector<Geometry::Point2D>& polygon, const Geometry::Point2D& p, double tolerance)
+    {
+	for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+	    Geometry::Vector2D d = polygon[i] - polygon[j];
+	    double t = std::clamp((p - polygon[j]) * d / std::max(d.normSqr(), 1e-300), 0.0, 1.0);
+	    if ((polygon[j] + d * t - p).norm() <= tolerance) {
+		return true;
+	    }
+	}
+	return false;
+    }
+}
+
+/*
+ * Called by Triangle (built with EXTERNAL_TEST) for every triangle considered for refinement when the -u switch is given.
+*/
+extern "C" int triunsuitable(double* triorg, double* tridest, double* triapex, double area)
+{
+    return currentField != nullptr && currentField->unsuitable(triorg, tridest, triapex, area);
+}
+
+Geometry::SizingField::SizingField(const ModifiedGordonWixomSurface& surface, double tolerance, double _minArea, int _resolution)
+    : min(surface.getBoundingRectangleMin()), resolution(std::max(_resolution, 2)), minArea(_minArea)
+{
+    // The samples only steer the refinement, so fewer directions will do:
+    ModifiedGordonWixomSurface sampler = surface;
+    sampler.setDirectionCount(std::max(8, surface.getDirectionCount() / 4));
+
+    const int n = resolution + 1;	// Grid nodes per axis
+    Point2D max = surface.getBoundingRectangleMax();
+    step = Vector2D((max[0] - min[0]) / resolution, (max[1] - min[1]) / resolution);
+    // Nodes outside the domain (outside the outer curve or inside a hole) stay unsampled, and so do nodes on a loop,
+    // where the surface is not defined by the interpolation:
+    const double eps = 1e-9 * (max - min).norm();
+    auto inDomain = [&surface, eps](const Point2D& p) {
+	if (!isInside(surface.getDiscretizedCurve(), p) || isOnBoundary(surface.getDiscretizedCurve(), p, eps)) {
+	    return false;
+	}
+	for (size_t l = 1; l < surface.getLoopCount(); l++) {
+	    if (isInside(surface.getDiscretizedLoop(l), p) || isOnBoundary(surface.getDiscretizedLoop(l), p, eps)) {
+		return false;
+	    }
+	}
+	return true;
+    };
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<double> values(n * n, nan);
+    parallelFor(values.size(), [&](size_t k) {
+	Point2D p(min[0] + (k % n) * step[0], min[1] + (k / n) * step[1]);
+	if (inDomain(p)) {
+	    values[k] = sampler.eval(p);
+	}
+    }, 1);
+
+    double low = std::numeric_limits<double>::infinity(), high = -low;
+    for (double u : values) {
+	if (!std::isnan(u)) {
+	    low = std::min(low, u);
+	    high = std::max(high, u);
+	}
+    }
+    maxError = tolerance * ((high > low) ? high - low : 1.0);
+
+    // Largest absolute eigenvalue of the Hessian at the nodes whose neighbours are all inside:
+    std::vector<double> nodeCurvature(n * n, nan);
+    auto u = [&](int i, int j) { return values[j * n + i]; };
+    for (int j = 1; j < n - 1; j++) {
+	for (int i = 1; i < n - 1; i++) {
+	    double uxx = (u(i + 1, j) - 2.0 * u(i, j) + u(i - 1, j)) / (step[0] * step[0]);
+	    double uyy = (u(i, j + 1) - 2.0 * u(i, j) + u(i, j - 1)) / (step[1] * step[1]);
+	    double uxy = (u(i + 1, j + 1) - u(i + 1, j - 1) - u(i - 1, j + 1) + u(i - 1, j - 1)) / (4.0 * step[0] * step[1]);
+	    nodeCurvature[j * n + i] = std::abs(0.5 * (uxx + uyy)) + std::sqrt(0.25 * (uxx - uyy) * (uxx - uyy) + uxy * uxy);
+	}
+    }
+
+    // Nodes near and outside the boundaries take the maximum of their known neighbours, layer by layer:
+    double maxCurvature = 0.0;
+    for (double k : nodeCurvature) {
+	if (!std::isnan(k)) {
+	    maxCurvature = std::max(maxCurvature, k);
+	}
+    }
+    for (bool changed = true; changed; ) {
+	changed = false;
+	std::vector<double> next = nodeCurvature;
+	for (int j = 0; j < n; j++) {
+	    for (int i = 0; i < n; i++) {
+		if (!std::isnan(nodeCurvature[j * n + i])) {
+		    continue;
+		}
+		for (int dj = -1; dj <= 1; dj++) {
+		    for (int di = -1; di <= 1; di++) {
+			int ni = i + di, nj = j + dj;
+			if (ni >= 0 && ni < n && nj >= 0 && nj < n && !std::isnan(nodeCurvature[nj * n + ni])) {
+			    next[j * n + i] = std::isnan(next[j * n + i]) ? nodeCurvature[nj * n + ni]
+										: std::max(next[j * n + i], nodeCurvature[nj * n + ni]);
+			    changed = true;
+			}
+		    }
+		}
+	    }
+	}
+	nodeCurvature.swap(next);
+    }
+
+    cellCurvature.resize(resolution * resolution);
+    for (int j = 0; j < resolution; j++) {
+	for (int i = 0; i < resolution; i++) {
+	    double k = std::max({ nodeCurvature[j * n + i], nodeCurvature[j * n + i + 1],
+				  nodeCurvature[(j + 1) * n + i], nodeCurvature[(j + 1) * n + i + 1] });
+	    cellCurvature[j * resolution + i] = std::isnan(k) ? maxCurvature : k;	// Only if no node was inside
+	}
+    }
+}
+
+bool Geometry::SizingField::unsuitable(const double* a, const double* b, const double* c, double area) const
+{
+    if (area < minArea) {
+	return false;
+    }
+    double ab = (b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]);
+    double bc = (c[0] - b[0]) * (c[0] - b[0]) + (c[1] - b[1]) * (c[1] - b[1]);
+    double ca = (a[0] - c[0]) * (a[0] - c[0]) + (a[1] - c[1]) * (a[1] - c[1]);
+    double k = std::max({ curvature(a[0], a[1]), curvature(b[0], b[1]), curvature(c[0], c[1]),
+			  curvature((a[0] + b[0] + c[0]) / 3.0, (a[1] + b[1] + c[1]) / 3.0) });
+    return std::max({ ab, bc, ca }) * k / 8.0 > maxError;
+}
+
+double Geometry::SizingField::curvature(double x, double y) const
+{
+    int i = std::clamp(static_cast<int>((x - min[0]) / step[0]), 0, resolution - 1);
+    int j = std::clamp(static_cast<int>((y - min[1]) / step[1]), 0, resolution - 1);
+    return cellCurvature[j * resolution + i];
+}
+
+Geometry::SizingField::Scope::Scope(const SizingField* field)
+    : previous(currentField)
+{
+    currentField = field;
+}
+
+Geometry::SizingField::Scope::~Scope()
+{
+    currentField = previous;
+}
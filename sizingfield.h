@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "modifiedgordonwixomsurface.h"
+
+namespace Geometry {
+
+  /*
+   * Curvature-based sizing field for Triangle's user-defined refinement test (-u switch).
+   * The surface is sampled once on a coarse grid over its bounding rectangle (with fewer directions than eval uses),
+   * and the second derivatives of the samples bound the error of linear interpolation on a triangle by h^2 * |D^2 u| / 8,
+   * where h is its longest edge.
+  */
+  class SizingField
+  {
+  public:
+    /*
+     * Triangles are refined until the estimated error is below tolerance times the sampled height range,
+     * but not below minArea.
+    */
+    SizingField(const ModifiedGordonWixomSurface& surface, double tolerance, double minArea, int resolution = 32);
+
+    bool unsuitable(const double* a, const double* b, const double* c, double area) const;
+
+    /*
+     * Makes triunsuitable() use the field in the current thread while the scope is alive.
+    */
+    class Scope
+    {
+    public:
+	explicit Scope(const SizingField* field);
+	~Scope();
+
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+
+    private:
+	const SizingField* previous;
+    };
+
+  private:
+    // Maximal absolute second derivative over the grid cell containing (x, y).
+    double curvature(double x, double y) const;
+
+    Point2D min;
+    Vector2D step;
+    int resolution;
+    std::vector<double> cellCurvature;	// resolution x resolution cells
+    double maxError;
+    double minArea;
+  };
+}
@@ -639,18 +639,27 @@ struct memorypool {
 };
 
 
+/* The only global state.  Define THREADLOCAL as a thread storage class      */
+/*   (e.g. -DTHREADLOCAL=_Thread_local) so that triangulate() can be called  */
+/*   from several threads at the same time.                                  */
+
+#ifndef THREADLOCAL
+#define THREADLOCAL
+#endif /* not THREADLOCAL */
+
 /* Global constants.                                                         */
 
-REAL splitter;       /* Used to split REAL factors for exact multiplication. */
-REAL epsilon;                             /* Floating-point machine epsilon. */
-REAL resulterrbound;
-REAL ccwerrboundA, ccwerrboundB, ccwerrboundC;
-REAL iccerrboundA, iccerrboundB, iccerrboundC;
-REAL o3derrboundA, o3derrboundB, o3derrboundC;
+/* Used to split REAL factors for exact multiplication.                      */
+THREADLOCAL REAL splitter;
+THREADLOCAL REAL epsilon;                 /* Floating-point machine epsilon. */
+THREADLOCAL REAL resulterrbound;
+THREADLOCAL REAL ccwerrboundA, ccwerrboundB, ccwerrboundC;
+THREADLOCAL REAL iccerrboundA, iccerrboundB, iccerrboundC;
+THREADLOCAL REAL o3derrboundA, o3derrboundB, o3derrboundC;
 
 /* Random number seed is not constant, but I've made it global anyway.       */
 
-unsigned long randomseed;                     /* Current random number seed. */
+THREADLOCAL unsigned long randomseed;         /* Current random number seed. */
 
 
 /* Mesh data structure.  Triangle operates on only one mesh, but the mesh    */
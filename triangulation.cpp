@@ -0,0 +1,88 @@
+#include "triangulation.h"
+
+#include <utility>
+
+#define ANSI_DECLARATORS
+#define REAL double
+#define VOID void
+
+extern "C" {
+#include "triangle/triangle.h"
+}
+
+struct Geometry::Triangulation::Output {
+    triangulateio io = {};	// All arrays null, as Triangle expects for the output.
+
+    ~Output()
+    {
+	// Only the arrays Triangle allocates; the others are never set in the output.
+	trifree(io.pointlist);
+	trifree(io.pointattributelist);
+	trifree(io.pointmarkerlist);
+	trifree(io.trianglelist);
+	trifree(io.triangleattributelist);
+	trifree(io.neighborlist);
+	trifree(io.segmentlist);
+	trifree(io.segmentmarkerlist);
+	trifree(io.edgelist);
+	trifree(io.edgemarkerlist);
+    }
+};
+
+Geometry::Triangulation::Triangulation(const std::string& switches, const std::vector<double>& points,
+				       const std::vector<int>& segments, const std::vector<double>& holes)
+    : out(std::make_unique<Output>())
+{
+    if (points.size() < 6) {
+	return;
+    }
+    triangulateio in = {};
+    in.pointlist = const_cast<double*>(points.data());
+    in.numberofpoints = static_cast<int>(points.size() / 2);
+    in.segmentlist = segments.empty() ? nullptr : const_cast<int*>(segments.data());
+    in.numberofsegments = static_cast<int>(segments.size() / 2);
+    in.holelist = holes.empty() ? nullptr : const_cast<double*>(holes.data());
+    in.numberofholes = static_cast<int>(holes.size() / 2);
+
+    std::string command = switches;
+    if (command.find('z') == std::string::npos) {
+	command += 'z';
+    }
+    triangulate(command.data(), &in, &out->io, nullptr);
+}
+
+Geometry::Triangulation::~Triangulation() = default;
+
+Geometry::Triangulation::Triangulation(Triangulation&& other) noexcept = default;
+
+Geometry::Triangulation& Geometry::Triangulation::operator=(Triangulation&& other) noexcept = default;
+
+size_t Geometry::Triangulation::pointCount() const
+{
+    return out ? out->io.numberofpoints : 0;
+}
+
+const double* Geometry::Triangulation::points() const
+{
+    return out ? out->io.pointlist : nullptr;
+}
+
+const int* Geometry::Triangulation::pointMarkers() const
+{
+    return out ? out->io.pointmarkerlist : nullptr;
+}
+
+size_t Geometry::Triangulation::triangleCount() const
+{
+    return out ? out->io.numberoftriangles : 0;
+}
+
+const int* Geometry::Triangulation::triangles() const
+{
+    return out ? out->io.trianglelist : nullptr;
+}
+
+int* Geometry::Triangulation::releaseTriangles()
+{
+    return out ? std::exchange(out->io.trianglelist, nullptr) : nullptr;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Geometry {
+
+  /*
+   * One run of the Triangle library, owning its output arrays (freed by the destructor).
+   * Triangle is compiled with its global state thread-local, so triangulations may run in several threads at once.
+  */
+  class Triangulation
+  {
+  public:
+    /*
+     * Triangulates points (x, y pairs) with segments (index pairs) and holes (x, y seed pairs) using the given
+     * Triangle switches; zero-based indexing (z) is always used. Fewer than three points give an empty triangulation,
+     * as Triangle would terminate the process.
+    */
+    Triangulation(const std::string& switches, const std::vector<double>& points,
+		  const std::vector<int>& segments = {}, const std::vector<double>& holes = {});
+
+    ~Triangulation();
+
+    Triangulation(Triangulation&& other) noexcept;
+    Triangulation& operator=(Triangulation&& other) noexcept;
+
+    Triangulation(const Triangulation&) = delete;
+    Triangulation& operator=(const Triangulation&) = delete;
+
+    size_t pointCount() const;
+
+    /*
+     * x, y pairs.
+    */
+    const double* points() const;
+
+    /*
+     * Boundary markers of the points (non-zero on segments); null with the B switch.
+    */
+    const int* pointMarkers() const;
+
+    size_t triangleCount() const;
+
+    /*
+     * Vertex index triples.
+    */
+    const int* triangles() const;
+
+    /*
+     * Hands the triangle array over to the caller, who frees it with std::free (e.g. TriMesh::adoptTriangles).
+    */
+    int* releaseTriangles();
+
+  private:
+    struct Output;	// Hides Triangle's triangulateio.
+
+    std::unique_ptr<Output> out;
+  };
+}
@@ -0,0 +1,206 @@
+#include "triangulationcache.h"
+#include "meshwriter.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+    constexpr char magic[4] = { 'P', 'H', 'T', 'C' };
+    constexpr uint32_t version = 1;
+
+    // FNV-1a
+    uint64_t hashBytes(uint64_t h, const void* data, size_t size)
+    {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+	    h = (h ^ bytes[i]) * 1099511628211ull;
+	}
+	return h;
+    }
+
+    bool sameBoundary(const std::vector<Geometry::Point2D>& a, const std::vector<Geometry::Point2D>& b)
+    {
+	return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(Geometry::Point2D)) == 0);
+    }
+
+    template <typename T>
+    bool read(std::FILE* file, T* data, size_t count)
+    {
+	return std::fread(data, sizeof(T), count, file) == count;
+    }
+}
+
+Geometry::TriangulationCache::TriangulationCache(const std::string& _directory)
+    : directory(_directory)
+{
+}
+
+bool Geometry::TriangulationCache::find(const std::vector<Point2D>& boundary, const std::string& switches, TriMesh& mesh)
+{
+    uint64_t key = hash(boundary, switches);
+    std::shared_ptr<const TriMesh> cached;
+    {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto range = entries.equal_range(key);
+	for (auto it = range.first; it != range.second && !cached; ++it) {
+	    if (it->second.switches == switches && sameBoundary(it->second.boundary, boundary)) {
+		cached = it->second.mesh;
+	    }
+	}
+    }
+    if (!cached && !directory.empty()) {
+	cached = load(key, boundary, switches);
+	if (cached) {
+	    std::lock_guard<std::mutex> lock(mutex);
+	    entries.emplace(key, Entry{ boundary, switches, cached });
+	}
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!cached) {
+	missCount++;
+	return false;
+    }
+    hitCount++;
+    mesh = *cached;
+    return true;
+}
+
+void Geometry::TriangulationCache::insert(const std::vector<Point2D>& boundary, const std::string& switches, const TriMesh& mesh)
+{
+    uint64_t key = hash(boundary, switches);
+    Entry entry{ boundary, switches, std::make_shared<const TriMesh>(mesh) };
+    if (!directory.empty()) {
+	store(key, entry);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.emplace(key, std::move(entry));
+}
+
+size_t Geometry::TriangulationCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+}
+
+size_t Geometry::TriangulationCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return missCount;
+}
+
+uint64_t Geometry::TriangulationCache::hash(const std::vector<Point2D>& boundary, const std::string& switches)
+{
+    uint64_t h = 14695981039346656037ull;
+    h = hashBytes(h, switches.data(), switches.size());
+    return hashBytes(h, boundary.data(), boundary.size() * sizeof(Point2D));
+}
+
+std::string Geometry::TriangulationCache::path(uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.tri", static_cast<unsigned long long>(key));
+    return directory + "/" + name;
+}
+
+/*
+ * File layout (native byte order, as the files are only meant for the machine that wrote them):
+ * magic, version, switches, boundary points, mesh points (x, y), triangles (3 x int32).
+ * The switches and the boundary are compared on loading, so hash collisions are harmless.
+*/
+std::shared_ptr<const Geometry::TriMesh> Geometry::TriangulationCache::load(uint64_t key, const std::vector<Point2D>& boundary,
+									       const std::string& switches) const
+{
+    std::FILE* file = std::fopen(path(key).c_str(), "rb");
+    if (file == nullptr) {
+	return nullptr;
+    }
+    std::fseek(file, 0, SEEK_END);
+    const uint64_t length = std::ftell(file);
+    std::rewind(file);
+    auto fits = [length](uint64_t count, size_t elementSize) { return count <= length / elementSize; };	// Against corrupt sizes
+    char fileMagic[4];
+    uint32_t fileVersion;
+    uint64_t size;
+    std::string fileSwitches;
+    std::vector<Point2D> fileBoundary;
+    std::vector<double> points;
+    std::vector<TriMesh::Triangle> triangles;
+    bool ok = read(file, fileMagic, 4) && std::memcmp(fileMagic, magic, 4) == 0
+	&& read(file, &fileVersion, 1) && fileVersion == version
+	&& read(file, &size, 1) && size == switches.size();
+    if (ok) {
+	fileSwitches.resize(size);
+	ok = read(file, fileSwitches.data(), size) && fileSwitches == switches
+	    && read(file, &size, 1) && size == boundary.size();
+    }
+    if (ok) {
+	fileBoundary.resize(size);
+	ok = read(file, fileBoundary.data(), size) && sameBoundary(fileBoundary, boundary)
+	    && read(file, &size, 1) && fits(size, 2 * sizeof(double));
+    }
+    if (ok) {
+	points.resize(2 * size);
+	ok = read(file, points.data(), points.size()) && read(file, &size, 1) && fits(size, sizeof(TriMesh::Triangle));
+    }
+    if (ok) {
+	triangles.resize(size);
+	ok = read(file, triangles.data(), size);
+	for (size_t i = 0; ok && i < triangles.size(); i++) {
+	    for (int index : triangles[i]) {
+		ok = ok && index >= 0 && static_cast<size_t>(index) < points.size() / 2;
+	    }
+	}
+    }
+    std::fclose(file);
+    if (!ok) {
+	return nullptr;
+    }
+    std::shared_ptr<TriMesh> mesh = std::make_shared<TriMesh>();
+    mesh->resizePoints(points.size() / 2);
+    for (size_t i = 0; i < points.size() / 2; i++) {
+	(*mesh)[i] = Point3D(points[2 * i], 0.0, points[2 * i + 1]);
+    }
+    mesh->setTriangles(triangles);
+    return mesh;
+}
+
+void Geometry::TriangulationCache::store(uint64_t key, const Entry& entry) const
+{
+    // Written under a temporary name and renamed, so concurrent runs never see partial files.
+    std::string filename = path(key);
+    std::string temporary = filename + "." + std::to_string(getpid()) + "."
+	+ std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    bool ok;
+    {
+	BufferedWriter writer(temporary.c_str());
+	uint64_t size = entry.switches.size();
+	writer.write(magic, sizeof(magic));
+	writer.write(&version, sizeof(version));
+	writer.write(&size, sizeof(size));
+	writer.write(entry.switches.data(), size);
+	size = entry.boundary.size();
+	writer.write(&size, sizeof(size));
+	writer.write(entry.boundary.data(), size * sizeof(Point2D));
+	size = entry.mesh->points().size();
+	writer.write(&size, sizeof(size));
+	for (const Point3D& p : entry.mesh->points()) {
+	    const double xy[2] = { p[0], p[2] };
+	    writer.write(xy, sizeof(xy));
+	}
+	size = entry.mesh->triangles().size();
+	writer.write(&size, sizeof(size));
+	writer.write(entry.mesh->triangles().data(), size * sizeof(TriMesh::Triangle));
+	writer.flush();
+	ok = writer.good();
+    }
+    if (!ok || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+	std::remove(temporary.c_str());
+	std::cout << "Could not write " << filename << " to the triangulation cache." << std::endl;
+    }
+}
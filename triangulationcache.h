@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "geometry.hh"
+
+namespace Geometry {
+
+  /*
+   * Planar triangulations (points (x, 0, y) like in write_geometry) keyed by the content of the discretized boundary
+   * and the Triangle switches, so surfaces over the same domain only triangulate it once.
+   * Entries are kept in memory and, if a directory is given, also stored there as <hash>.tri files for later runs.
+   * Thread-safe.
+  */
+  class TriangulationCache
+  {
+  public:
+    explicit TriangulationCache(const std::string& directory = std::string());
+
+    /*
+     * Copies the cached triangulation into mesh; false if there is none.
+    */
+    bool find(const std::vector<Point2D>& boundary, const std::string& switches, TriMesh& mesh);
+
+    void insert(const std::vector<Point2D>& boundary, const std::string& switches, const TriMesh& mesh);
+
+    size_t hits() const;
+
+    size_t misses() const;
+
+  private:
+    struct Entry {
+	std::vector<Point2D> boundary;
+	std::string switches;
+	std::shared_ptr<const TriMesh> mesh;
+    };
+
+    static uint64_t hash(const std::vector<Point2D>& boundary, const std::string& switches);
+
+    std::string path(uint64_t key) const;
+
+    std::shared_ptr<const TriMesh> load(uint64_t key, const std::vector<Point2D>& boundary, const std::string& switches) const;
+
+    void store(uint64_t key, const Entry& entry) const;
+
+    std::string directory;
+    mutable std::mutex mutex;
+    std::unordered_multimap<uint64_t, Entry> entries;
+    size_t hitCount = 0;
+    size_t missCount = 0;
+  };
+}
@@ -0,0 +1,860 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "geometry.hh"
+#include "mappedfile.h"
+#include "meshwriter.h"
+#include "parallel.h"
+
+namespace Geometry {
+
+namespace {
+
+// Parsed content of a line-aligned part of an OBJ file.
+struct OBJChunk {
+  PointVector points;
+  std::vector<std::array<long long, 3>> faces; // zero-based vertex indices
+  std::vector<unsigned char> relative;         // bit i: index i is relative to the start of the chunk
+};
+
+bool isBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char *skipBlanks(const char *p, const char *end) {
+  while (p < end && isBlank(*p))
+    ++p;
+  return p;
+}
+
+const char *parseDouble(const char *p, const char *end, double &x) {
+  p = skipBlanks(p, end);
+  if (p < end && *p == '+')
+    ++p;
+  auto result = std::from_chars(p, end, x);
+  return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+// Parses the vertex index of a face corner (v, v/vt, v//vn or v/vt/vn).
+const char *parseCorner(const char *p, const char *end, long long &index) {
+  p = skipBlanks(p, end);
+  auto result = std::from_chars(p, end, index);
+  if (result.ec != std::errc())
+    return nullptr;
+  p = result.ptr;
+  while (p < end && !isBlank(*p) && *p != '\n')
+    ++p;
+  return p;
+}
+
+void parseOBJChunk(const char *p, const char *end, OBJChunk &chunk) {
+  while (p < end) {
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (!eol)
+      eol = end;
+    p = skipBlanks(p, eol);
+    if (eol - p > 1 && p[0] == 'v' && isBlank(p[1])) {
+      Point3D v(0, 0, 0);
+      const char *q = p + 1;
+      for (int i = 0; i < 3 && q; ++i)
+        q = parseDouble(q, eol, v[i]);
+      if (q)
+        chunk.points.push_back(v);
+    } else if (eol - p > 1 && p[0] == 'f' && isBlank(p[1])) {
+      // Polygons are split into a triangle fan.
+      std::array<long long, 3> face;
+      unsigned char relative = 0;
+      const char *q = p + 1;
+      long long index;
+      for (size_t corner = 0; (q = parseCorner(q, eol, index)) != nullptr; ++corner) {
+        size_t i = std::min<size_t>(corner, 2);
+        if (corner > 2) {
+          face[1] = face[2];
+          relative = (relative & 1) | ((relative & 4) >> 1);
+        }
+        if (index < 0) {
+          face[i] = static_cast<long long>(chunk.points.size()) + index;
+          relative |= 1 << i;
+        } else {
+          face[i] = index - 1;
+          relative &= ~(1 << i);
+        }
+        if (corner >= 2) {
+          chunk.faces.push_back(face);
+          chunk.relative.push_back(relative);
+        }
+      }
+    }
+    p = eol + 1;
+  }
+}
+
+// Spatial hash of points in cubic cells: cells are hashed into (at least) twice as many buckets as points,
+// and the points are sorted by bucket (counting sort), so the points of a bucket are contiguous.
+class PointGrid {
+public:
+  PointGrid(const PointVector &points, double cell_size)
+    : points_(points), inv_cell_(1.0 / cell_size) {
+    size_t n_buckets = 1;
+    while (n_buckets < 2 * points.size())
+      n_buckets *= 2;
+    mask_ = n_buckets - 1;
+    std::vector<uint32_t> bucket(points.size());
+    parallelFor(points.size(), [&](size_t i) {
+      bucket[i] = static_cast<uint32_t>(hash(cell(points[i][0]), cell(points[i][1]), cell(points[i][2])));
+    }, 4096);
+    start_.assign(n_buckets + 1, 0);
+    for (uint32_t b : bucket)
+      start_[b + 1]++;
+    for (size_t b = 0; b < n_buckets; ++b)
+      start_[b + 1] += start_[b];
+    std::vector<uint32_t> fill(start_.begin(), start_.end() - 1);
+    indices_.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i)
+      indices_[fill[bucket[i]]++] = static_cast<int>(i);
+  }
+
+  // The index of the nearest point within tolerance (at most the cell size) for which accept(index) holds, or -1.
+  template <typename Accept>
+  int nearest(const Point3D &p, double tolerance, Accept &&accept) const {
+    // Only the (at most 8) cells overlapping the ball of radius tolerance around p:
+    const double q[3] = { p[0], p[1], p[2] };
+    long long lo[3], hi[3];
+    for (int i = 0; i < 3; ++i) {
+      lo[i] = cell(q[i] - tolerance);
+      hi[i] = cell(q[i] + tolerance);
+    }
+    int best = -1;
+    double best_distance = tolerance * tolerance;
+    for (long long i = lo[0]; i <= hi[0]; ++i)
+      for (long long j = lo[1]; j <= hi[1]; ++j)
+        for (long long k = lo[2]; k <= hi[2]; ++k) {
+          size_t b = hash(i, j, k);
+          for (uint32_t s = start_[b]; s < start_[b + 1]; ++s) {
+            int index = indices_[s];
+            const Point3D &r = points_[index];
+            double dx = r[0] - q[0], dy = r[1] - q[1], dz = r[2] - q[2];
+            double distance = dx * dx + dy * dy + dz * dz;
+            if (distance <= best_distance && (best < 0 || distance < best_distance || index < best) &&
+                accept(index)) {
+              best = index;
+              best_distance = distance;
+            }
+          }
+        }
+    return best;
+  }
+
+private:
+  long long cell(double x) const {
+    // Clamped (keeping the order), so that far away or non-finite coordinates cannot overflow the cast.
+    constexpr double limit = 1.0e15;
+    double c = std::floor(x * inv_cell_);
+    return static_cast<long long>(c > -limit ? std::min(c, limit) : -limit);
+  }
+  size_t hash(long long i, long long j, long long k) const {
+    // Teschner et al., Optimized spatial hashing for collision detection of deformable objects
+    return (static_cast<size_t>(i) * 73856093u ^ static_cast<size_t>(j) * 19349663u ^
+            static_cast<size_t>(k) * 83492791u) & mask_;
+  }
+
+  const PointVector &points_;
+  double inv_cell_;
+  size_t mask_;
+  std::vector<uint32_t> start_;
+  std::vector<int> indices_;
+};
+
+// Closest point of the triangle abc to p, with its barycentric coordinates (Ericson, Real-Time Collision Detection, 5.1.5).
+Point3D closestPointOnTriangle(const Point3D &p, const Point3D &a, const Point3D &b, const Point3D &c,
+                               std::array<double, 3> &bary) {
+  Vector3D ab = b - a, ac = c - a, ap = p - a;
+  double d1 = ab * ap, d2 = ac * ap;
+  if (d1 <= 0 && d2 <= 0) {
+    bary = { 1, 0, 0 };
+    return a;
+  }
+  Vector3D bp = p - b;
+  double d3 = ab * bp, d4 = ac * bp;
+  if (d3 >= 0 && d4 <= d3) {
+    bary = { 0, 1, 0 };
+    return b;
+  }
+  double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    double v = d1 / (d1 - d3);
+    bary = { 1 - v, v, 0 };
+    return a + ab * v;
+  }
+  Vector3D cp = p - c;
+  double d5 = ab * cp, d6 = ac * cp;
+  if (d6 >= 0 && d5 <= d6) {
+    bary = { 0, 0, 1 };
+    return c;
+  }
+  double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    double w = d2 / (d2 - d6);
+    bary = { 1 - w, 0, w };
+    return a + ac * w;
+  }
+  double va = d3 * d6 - d5 * d4;
+  if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+    double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    bary = { 0, 1 - w, w };
+    return b + (c - b) * w;
+  }
+  double denom = va + vb + vc;
+  if (denom == 0) { // degenerate triangle, all corners on one line
+    bary = { 1, 0, 0 };
+    return a;
+  }
+  double v = vb / denom, w = vc / denom;
+  bary = { 1 - v - w, v, w };
+  return a + ab * v + ac * w;
+}
+
+} // namespace
+
+// Four-wide bounding volume hierarchy over the triangles. The boxes of the children of a node are
+// stored coordinate-wise, so the distances to all four are computed together with SIMD instructions.
+struct TriMesh::BVH {
+  static constexpr int width = 4;
+  static constexpr size_t leaf_size = 4;
+
+  struct Node {
+    alignas(32) double min[3][width];
+    alignas(32) double max[3][width];
+    int child[width];       // index of an inner node, or -1
+    uint32_t first[width];  // leaf: range of triangles in order (count > 0)
+    uint32_t count[width];
+  };
+
+  std::vector<Node> nodes;
+  std::vector<int> order;                      // triangle indices, leaves are contiguous ranges
+  std::vector<std::array<Point3D, 3>> corners; // triangle corners in the same order
+
+  BVH(const PointVector &points, std::span<const Triangle> triangles);
+  Projection closest(const Point3D &p) const;
+
+private:
+  static void boxDistances(const Node &node, const double q[3], double d[width]);
+  int build(size_t begin, size_t end, const PointVector &points, std::span<const Triangle> triangles,
+            const std::vector<Point3D> &centroids);
+};
+
+TriMesh::BVH::BVH(const PointVector &points, std::span<const Triangle> triangles)
+  : order(triangles.size()) {
+  std::vector<Point3D> centroids(triangles.size());
+  for (size_t i = 0; i < triangles.size(); ++i) {
+    const auto &t = triangles[i];
+    order[i] = static_cast<int>(i);
+    centroids[i] = (points[t[0]] + points[t[1]] + points[t[2]]) / 3.0;
+  }
+  nodes.reserve(2 * triangles.size() / leaf_size + 1);
+  build(0, triangles.size(), points, triangles, centroids);
+  corners.resize(triangles.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    const auto &t = triangles[order[i]];
+    corners[i] = { points[t[0]], points[t[1]], points[t[2]] };
+  }
+}
+
+int
+TriMesh::BVH::build(size_t begin, size_t end, const PointVector &points, std::span<const Triangle> triangles,
+                    const std::vector<Point3D> &centroids) {
+  // Split the range into (at most) four parts, always halving the largest one at the median centroid
+  // along the longest axis of its centroids' bounding box:
+  std::array<std::pair<size_t, size_t>, width> parts;
+  parts[0] = { begin, end };
+  int n_parts = 1;
+  while (n_parts < width) {
+    int largest = 0;
+    for (int i = 1; i < n_parts; ++i)
+      if (parts[i].second - parts[i].first > parts[largest].second - parts[largest].first)
+        largest = i;
+    auto [first, last] = parts[largest];
+    if (last - first <= leaf_size)
+      break;
+    Point3D lo = centroids[order[first]], hi = lo;
+    for (size_t i = first; i < last; ++i)
+      for (int j = 0; j < 3; ++j) {
+        lo[j] = std::min(lo[j], centroids[order[i]][j]);
+        hi[j] = std::max(hi[j], centroids[order[i]][j]);
+      }
+    int axis = 0;
+    for (int j = 1; j < 3; ++j)
+      if (hi[j] - lo[j] > hi[axis] - lo[axis])
+        axis = j;
+    size_t middle = (first + last) / 2;
+    std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + last,
+                     [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+    parts[largest] = { first, middle };
+    parts[n_parts++] = { middle, last };
+  }
+
+  int index = static_cast<int>(nodes.size());
+  nodes.emplace_back();
+  for (int i = 0; i < width; ++i) {
+    Node &node = nodes[index];
+    node.child[i] = -1;
+    node.first[i] = node.count[i] = 0;
+    for (int j = 0; j < 3; ++j) {
+      node.min[j][i] = std::numeric_limits<double>::infinity();
+      node.max[j][i] = -std::numeric_limits<double>::infinity();
+    }
+  }
+  for (int i = 0; i < n_parts; ++i) {
+    auto [first, last] = parts[i];
+    int child = -1;
+    if (last - first > leaf_size)
+      child = build(first, last, points, triangles, centroids); // may reallocate nodes
+    Node &node = nodes[index];
+    node.child[i] = child;
+    if (child < 0) {
+      node.first[i] = static_cast<uint32_t>(first);
+      node.count[i] = static_cast<uint32_t>(last - first);
+    }
+    for (size_t k = first; k < last; ++k)
+      for (int corner : triangles[order[k]])
+        for (int j = 0; j < 3; ++j) {
+          node.min[j][i] = std::min(node.min[j][i], points[corner][j]);
+          node.max[j][i] = std::max(node.max[j][i], points[corner][j]);
+        }
+  }
+  return index;
+}
+
+// Squared distances of q to the four child boxes of the node.
+void
+TriMesh::BVH::boxDistances(const Node &node, const double q[3], double d[width]) {
+#ifdef __SSE2__
+  const __m128d zero = _mm_setzero_pd();
+  __m128d d01 = zero, d23 = zero;
+  for (int j = 0; j < 3; ++j) {
+    const __m128d c = _mm_set1_pd(q[j]);
+    __m128d t01 = _mm_max_pd(_mm_max_pd(_mm_sub_pd(_mm_load_pd(node.min[j]), c), zero),
+                             _mm_sub_pd(c, _mm_load_pd(node.max[j])));
+    __m128d t23 = _mm_max_pd(_mm_max_pd(_mm_sub_pd(_mm_load_pd(node.min[j] + 2), c), zero),
+                             _mm_sub_pd(c, _mm_load_pd(node.max[j] + 2)));
+    d01 = _mm_add_pd(d01, _mm_mul_pd(t01, t01));
+    d23 = _mm_add_pd(d23, _mm_mul_pd(t23, t23));
+  }
+  _mm_store_pd(d, d01);
+  _mm_store_pd(d + 2, d23);
+#else
+  for (int i = 0; i < width; ++i)
+    d[i] = 0.0;
+  for (int j = 0; j < 3; ++j)
+    for (int i = 0; i < width; ++i) {
+      double t = std::max(std::max(node.min[j][i] - q[j], 0.0), q[j] - node.max[j][i]);
+      d[i] += t * t;
+    }
+#endif
+}
+
+TriMesh::Projection
+TriMesh::BVH::closest(const Point3D &p) const {
+  Projection result;
+  result.triangle = 0;
+  double best = std::numeric_limits<double>::infinity(); // squared distance
+  const double q[3] = { p[0], p[1], p[2] };               // Vector3D's accessors are not inlined
+
+  // Depth-first, nearer children first; the depth is logarithmic, as all splits are at the median.
+  std::pair<int, double> stack[128];
+  int top = 0;
+  stack[top++] = { 0, 0.0 };
+  while (top > 0) {
+    auto [index, distance] = stack[--top];
+    if (distance >= best)
+      continue;
+    const Node &node = nodes[index];
+    alignas(16) double d[width];
+    boxDistances(node, q, d);
+    // Leaves first, as they can only tighten the bound:
+    for (int i = 0; i < width; ++i) {
+      if (node.count[i] == 0 || d[i] >= best)
+        continue;
+      for (uint32_t k = node.first[i], end = node.first[i] + node.count[i]; k < end; ++k) {
+        std::array<double, 3> bary;
+        Point3D q = closestPointOnTriangle(p, corners[k][0], corners[k][1], corners[k][2], bary);
+        double dist = (q - p).normSqr();
+        if (dist < best) {
+          best = dist;
+          result.triangle = order[k];
+          result.point = q;
+          result.barycentric = bary;
+        }
+      }
+    }
+    int children[width], n_children = 0;
+    for (int i = 0; i < width; ++i)
+      if (node.child[i] >= 0 && d[i] < best)
+        children[n_children++] = i;
+    std::sort(children, children + n_children, [&](int a, int b) { return d[a] > d[b]; });
+    for (int i = 0; i < n_children; ++i)
+      stack[top++] = { node.child[children[i]], d[children[i]] };
+  }
+  result.distance = std::sqrt(best);
+  return result;
+}
+
+static_assert(sizeof(TriMesh::Triangle) == 3 * sizeof(int), "Triangle must be layout-compatible with int[3]");
+
+void
+TriMesh::FreeDeleter::operator()(void *p) const {
+  std::free(p);
+}
+
+TriMesh::TriMesh(const TriMesh &other)
+  : points_(other.points_), normals_(other.normals_) {
+  reserveTriangles(other.n_triangles_);
+  std::copy_n(other.triangles_.get(), other.n_triangles_, triangles_.get());
+  n_triangles_ = other.n_triangles_;
+  std::lock_guard<std::mutex> lock(other.bvh_mutex_);
+  bvh_ = other.bvh_; // immutable, can be shared
+}
+
+TriMesh::TriMesh(TriMesh &&other) noexcept
+  : points_(std::move(other.points_)), normals_(std::move(other.normals_)),
+    triangles_(std::move(other.triangles_)), n_triangles_(other.n_triangles_), capacity_(other.capacity_),
+    bvh_(std::move(other.bvh_)) {
+  other.n_triangles_ = 0;
+  other.capacity_ = 0;
+}
+
+TriMesh &
+TriMesh::operator=(const TriMesh &other) {
+  if (this != &other) {
+    TriMesh copy(other);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+TriMesh &
+TriMesh::operator=(TriMesh &&other) noexcept {
+  points_ = std::move(other.points_);
+  normals_ = std::move(other.normals_);
+  triangles_ = std::move(other.triangles_);
+  n_triangles_ = other.n_triangles_;
+  capacity_ = other.capacity_;
+  bvh_ = std::move(other.bvh_);
+  other.n_triangles_ = 0;
+  other.capacity_ = 0;
+  return *this;
+}
+
+void
+TriMesh::clear() {
+  bvh_.reset();
+  points_.clear();
+  normals_.clear();
+  triangles_.reset();
+  n_triangles_ = 0;
+  capacity_ = 0;
+}
+
+void
+TriMesh::resizePoints(size_t n) {
+  bvh_.reset();
+  points_.resize(n);
+}
+
+void
+TriMesh::setPoints(const PointVector &pv) {
+  bvh_.reset();
+  points_ = pv;
+}
+
+void
+TriMesh::addTriangle(size_t a, size_t b, size_t c) {
+  bvh_.reset();
+  if (n_triangles_ == capacity_)
+    reserveTriangles(std::max<size_t>(16, 2 * capacity_));
+  triangles_[n_triangles_++] = { static_cast<int>(a), static_cast<int>(b), static_cast<int>(c) };
+}
+
+void
+TriMesh::setTriangles(const std::vector<Triangle> &tl) {
+  bvh_.reset();
+  n_triangles_ = 0;
+  reserveTriangles(tl.size());
+  std::copy(tl.begin(), tl.end(), triangles_.get());
+  n_triangles_ = tl.size();
+}
+
+void
+TriMesh::adoptTriangles(int *indices, size_t n) {
+  bvh_.reset();
+  triangles_.reset(reinterpret_cast<Triangle *>(indices));
+  n_triangles_ = n;
+  capacity_ = n;
+}
+
+TriMesh &
+TriMesh::append(const TriMesh &other) {
+  bvh_.reset();
+  size_t offset = points_.size();
+  if (!normals_.empty() || !other.normals_.empty()) {
+    normals_.resize(offset, Vector3D(0, 0, 0));
+    normals_.insert(normals_.end(), other.normals_.begin(), other.normals_.end());
+    normals_.resize(offset + other.points_.size(), Vector3D(0, 0, 0));
+  }
+  points_.insert(points_.end(), other.points_.begin(), other.points_.end());
+  reserveTriangles(n_triangles_ + other.n_triangles_);
+  for (const auto &t : other.triangles())
+    triangles_[n_triangles_++] = { t[0] + static_cast<int>(offset), t[1] + static_cast<int>(offset),
+                                   t[2] + static_cast<int>(offset) };
+  return *this;
+}
+
+TriMesh &
+TriMesh::insert(const TriMesh &other, double tolerance) {
+  const size_t n = other.points_.size();
+  if (n == 0)
+    return *this;
+  bvh_.reset();
+  tolerance = std::max(tolerance, 0.0);
+
+  // Cells of the size of the tolerance, so only the neighbouring cells need to be checked.
+  // Without tolerance (exact duplicates) any size works; one that gives a few points per cell is chosen.
+  // Both meshes are hashed, so the size comes from their combined bounding box, and it is kept well above
+  // the resolution of the coordinates (a tiny or degenerate mesh would give cell indices out of range).
+  Point3D lo = other.points_[0], hi = lo;
+  auto extend = [&](const PointVector &points) {
+    for (const auto &p : points)
+      for (int j = 0; j < 3; ++j) {
+        lo[j] = std::min(lo[j], p[j]);
+        hi[j] = std::max(hi[j], p[j]);
+      }
+  };
+  extend(points_);
+  extend(other.points_);
+  double magnitude = 0.0;
+  for (int j = 0; j < 3; ++j)
+    magnitude = std::max({ magnitude, std::abs(lo[j]), std::abs(hi[j]) });
+  double cell_size = tolerance;
+  if (cell_size == 0.0)
+    cell_size = (hi - lo).norm() / std::cbrt(static_cast<double>(points_.size() + n));
+  cell_size = std::max(cell_size, magnitude * 1.0e-12);
+  if (!(cell_size > 0.0) || !std::isfinite(cell_size)) // all points at the origin, or non-finite ones
+    cell_size = 1.0;
+
+  // First the vertices of this mesh, then the earlier vertices of other that are not welded themselves:
+  std::vector<int> existing(n, -1), earlier(n, -1);
+  {
+    PointGrid grid(points_, cell_size);
+    parallelFor(n, [&](size_t i) {
+      existing[i] = grid.nearest(other.points_[i], tolerance, [](int) { return true; });
+    }, 256);
+  }
+  if (std::find(existing.begin(), existing.end(), -1) != existing.end()) {
+    PointGrid grid(other.points_, cell_size);
+    parallelFor(n, [&](size_t i) {
+      if (existing[i] < 0)
+        earlier[i] = grid.nearest(other.points_[i], tolerance, [&](int j) {
+          return j < static_cast<int>(i) && existing[j] < 0;
+        });
+    }, 256);
+  }
+
+  // Resolve the indices in order, as a vertex may be welded to an earlier one:
+  std::vector<int> index(n);
+  size_t offset = points_.size(), added = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (existing[i] >= 0)
+      index[i] = existing[i];
+    else if (earlier[i] >= 0)
+      index[i] = index[earlier[i]];
+    else
+      index[i] = static_cast<int>(offset + added++);
+  }
+  bool with_normals = !normals_.empty() || !other.normals_.empty();
+  if (with_normals)
+    normals_.resize(offset, Vector3D(0, 0, 0));
+  points_.reserve(offset + added);
+  for (size_t i = 0; i < n; ++i)
+    if (index[i] == static_cast<int>(points_.size())) { // new vertex
+      points_.push_back(other.points_[i]);
+      if (with_normals)
+        normals_.push_back(i < other.normals_.size() ? other.normals_[i] : Vector3D(0, 0, 0));
+    }
+
+  reserveTriangles(n_triangles_ + other.n_triangles_);
+  for (const auto &t : other.triangles()) {
+    Triangle u = { index[t[0]], index[t[1]], index[t[2]] };
+    if (u[0] != u[1] && u[1] != u[2] && u[2] != u[0]) // collapsed by welding
+      triangles_[n_triangles_++] = u;
+  }
+  return *this;
+}
+
+TriMesh &
+TriMesh::subdivide() {
+  bvh_.reset();
+  const size_t n = points_.size();
+
+  // Number the edges by sorting their (smaller, larger) vertex index pairs, so shared edges get one midpoint.
+  std::vector<std::pair<uint64_t, size_t>> edges(3 * n_triangles_);
+  parallelFor(n_triangles_, [&](size_t i) {
+    const Triangle &t = triangles_[i];
+    for (int j = 0; j < 3; ++j) {
+      uint64_t a = static_cast<uint32_t>(t[j]), b = static_cast<uint32_t>(t[(j + 1) % 3]);
+      edges[3 * i + j] = { std::min(a, b) << 32 | std::max(a, b), 3 * i + j };
+    }
+  }, 1024);
+  std::sort(edges.begin(), edges.end());
+  std::vector<int> midpoint(edges.size());
+  size_t added = 0;
+  for (size_t i = 0; i < edges.size(); ++i) {
+    if (i > 0 && edges[i].first != edges[i - 1].first)
+      ++added;
+    midpoint[edges[i].second] = static_cast<int>(n + added);
+  }
+  if (!edges.empty())
+    ++added;
+
+  points_.resize(n + added);
+  if (!normals_.empty())
+    normals_.resize(n + added, Vector3D(0, 0, 0));
+  for (size_t i = 0; i < edges.size(); ++i) {
+    if (i > 0 && edges[i].first == edges[i - 1].first)
+      continue;
+    size_t a = edges[i].first >> 32, b = edges[i].first & 0xffffffffu, m = midpoint[edges[i].second];
+    points_[m] = (points_[a] + points_[b]) / 2.0;
+    if (!normals_.empty()) {
+      Vector3D normal = normals_[a] + normals_[b];
+      normals_[m] = normal.norm() > 0.0 ? normal.normalize() : normal;
+    }
+  }
+
+  // Corner triangles first, then the middle one: (a, ab, ca), (ab, b, bc), (ca, bc, c), (ab, bc, ca).
+  const size_t m = n_triangles_;
+  reserveTriangles(4 * m);
+  parallelFor(m, [&](size_t i) {
+    Triangle t = triangles_[i];
+    int ab = midpoint[3 * i], bc = midpoint[3 * i + 1], ca = midpoint[3 * i + 2];
+    triangles_[i] = { t[0], ab, ca };
+    triangles_[m + 3 * i] = { ab, t[1], bc };
+    triangles_[m + 3 * i + 1] = { ca, bc, t[2] };
+    triangles_[m + 3 * i + 2] = { ab, bc, ca };
+  }, 1024);
+  n_triangles_ = 4 * m;
+  return *this;
+}
+
+const VectorVector &
+TriMesh::normals() const {
+  return normals_;
+}
+
+VectorVector &
+TriMesh::normals() {
+  return normals_;
+}
+
+Point3D &
+TriMesh::operator[](size_t i) {
+  return points_[i];
+}
+
+const Point3D &
+TriMesh::operator[](size_t i) const {
+  return points_[i];
+}
+
+const PointVector &
+TriMesh::points() const {
+  return points_;
+}
+
+std::span<const TriMesh::Triangle>
+TriMesh::triangles() const {
+  return { triangles_.get(), n_triangles_ };
+}
+
+std::span<TriMesh::Triangle>
+TriMesh::triangles() {
+  return { triangles_.get(), n_triangles_ };
+}
+
+TriMesh
+TriMesh::readOBJ(std::string filename) {
+  TriMesh mesh;
+  MappedFile file(filename);
+  if (!file.data())
+    return mesh;
+
+  // Split the file into line-aligned chunks and parse them in parallel:
+  constexpr size_t min_chunk_size = 1 << 20;
+  size_t n_chunks = std::max<size_t>(1, std::min<size_t>(4 * std::thread::hardware_concurrency(),
+                                                         file.size() / min_chunk_size));
+  std::vector<const char *> bounds(n_chunks + 1);
+  const char *end = file.data() + file.size();
+  bounds[0] = file.data();
+  bounds[n_chunks] = end;
+  for (size_t i = 1; i < n_chunks; ++i) {
+    const char *p = std::max(bounds[i - 1], file.data() + i * file.size() / n_chunks);
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    bounds[i] = eol ? eol + 1 : end;
+  }
+  std::vector<OBJChunk> chunks(n_chunks);
+  parallelFor(n_chunks, [&](size_t i) { parseOBJChunk(bounds[i], bounds[i + 1], chunks[i]); }, 1);
+
+  // Concatenate, resolving relative (negative) indices with the vertex offset of their chunk:
+  size_t n_points = 0, n_faces = 0;
+  for (const auto &chunk : chunks) {
+    n_points += chunk.points.size();
+    n_faces += chunk.faces.size();
+  }
+  mesh.points_.reserve(n_points);
+  mesh.reserveTriangles(n_faces);
+  for (const auto &chunk : chunks) {
+    long long offset = mesh.points_.size();
+    mesh.points_.insert(mesh.points_.end(), chunk.points.begin(), chunk.points.end());
+    for (size_t i = 0; i < chunk.faces.size(); ++i) {
+      Triangle t;
+      bool valid = true;
+      for (int j = 0; j < 3; ++j) {
+        long long index = chunk.faces[i][j] + ((chunk.relative[i] >> j) & 1 ? offset : 0);
+        valid = valid && index >= 0 && index < static_cast<long long>(n_points);
+        t[j] = static_cast<int>(index);
+      }
+      if (valid) // faces referring to missing vertices are dropped
+        mesh.triangles_[mesh.n_triangles_++] = t;
+    }
+  }
+  return mesh;
+}
+
+bool
+TriMesh::writeOBJ(std::string filename, int precision) const {
+  OBJWriter f(filename.c_str(), precision);
+  bool with_normals = normals_.size() == points_.size() && !normals_.empty();
+  for (size_t i = 0; i < points_.size(); ++i) {
+    f.vertex(points_[i][0], points_[i][1], points_[i][2]);
+    if (with_normals)
+      f.normal(normals_[i][0], normals_[i][1], normals_[i][2]);
+  }
+  for (const auto &t : triangles()) {
+    if (with_normals)
+      f.faceWithNormals(t[0], t[1], t[2]);
+    else
+      f.face(t[0], t[1], t[2]);
+  }
+  f.flush();
+  return f.good();
+}
+
+bool
+TriMesh::writeSTL(std::string filename) const {
+  BufferedWriter f(filename.c_str());
+  char header[80] = "binary STL";
+  f.write(header, sizeof(header));
+  uint32_t count = littleEndian(static_cast<uint32_t>(n_triangles_));
+  f.write(&count, sizeof(count));
+  for (const auto &t : triangles()) {
+    const Point3D &a = points_[t[0]], &b = points_[t[1]], &c = points_[t[2]];
+    Vector3D n = (b - a) ^ (c - a);
+    double length = n.norm();
+    if (length > 0.0)
+      n /= length;
+    float record[12] = {
+      static_cast<float>(n[0]), static_cast<float>(n[1]), static_cast<float>(n[2]),
+      static_cast<float>(a[0]), static_cast<float>(a[1]), static_cast<float>(a[2]),
+      static_cast<float>(b[0]), static_cast<float>(b[1]), static_cast<float>(b[2]),
+      static_cast<float>(c[0]), static_cast<float>(c[1]), static_cast<float>(c[2])
+    };
+    for (float &x : record)
+      x = littleEndian(x);
+    uint16_t attributes = 0;
+    f.write(record, sizeof(record));
+    f.write(&attributes, sizeof(attributes));
+  }
+  f.flush();
+  return f.good();
+}
+
+bool
+TriMesh::writePLY(std::string filename) const {
+  bool with_normals = normals_.size() == points_.size() && !normals_.empty();
+  PLYWriter f(filename.c_str(), points_.size(), n_triangles_, with_normals);
+  for (size_t i = 0; i < points_.size(); ++i) {
+    const Point3D &p = points_[i];
+    if (with_normals)
+      f.vertex(p[0], p[1], p[2], normals_[i][0], normals_[i][1], normals_[i][2]);
+    else
+      f.vertex(p[0], p[1], p[2]);
+  }
+  f.faces(reinterpret_cast<const int *>(triangles_.get()), n_triangles_);
+  f.flush();
+  return f.good();
+}
+
+const TriMesh::Triangle &
+TriMesh::closestTriangle(const Point3D &p) const {
+  return triangles_[project(p).triangle];
+}
+
+Point3D
+TriMesh::projectToTriangle(const Point3D &p, const Triangle &tri) const {
+  std::array<double, 3> bary;
+  return closestPointOnTriangle(p, points_[tri[0]], points_[tri[1]], points_[tri[2]], bary);
+}
+
+TriMesh::Projection
+TriMesh::project(const Point3D &p) const {
+  return bvh()->closest(p);
+}
+
+std::vector<TriMesh::Projection>
+TriMesh::project(const PointVector &pv) const {
+  std::vector<Projection> result(pv.size());
+  if (pv.empty())
+    return result;
+  std::shared_ptr<const BVH> hierarchy = bvh();
+  parallelFor(pv.size(), [&](size_t i) { result[i] = hierarchy->closest(pv[i]); });
+  return result;
+}
+
+void
+TriMesh::invalidateBVH() {
+  bvh_.reset();
+}
+
+std::shared_ptr<const TriMesh::BVH>
+TriMesh::bvh() const {
+  if (n_triangles_ == 0)
+    throw std::invalid_argument("closest point queries need a mesh with triangles");
+  std::lock_guard<std::mutex> lock(bvh_mutex_);
+  if (!bvh_)
+    bvh_ = std::make_shared<const BVH>(points_, triangles());
+  return bvh_;
+}
+
+void
+TriMesh::reserveTriangles(size_t n) {
+  if (n <= capacity_)
+    return;
+  void *memory = std::realloc(triangles_.get(), n * sizeof(Triangle));
+  if (!memory)
+    throw std::bad_alloc();
+  triangles_.release();
+  triangles_.reset(static_cast<Triangle *>(memory));
+  capacity_ = n;
+}
+
+} // namespace Geometry